@@ -0,0 +1,206 @@
+#pragma once
+#include "cell_grid.hpp"
+#include "vector3d.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace trj_render {
+
+// Below this many atoms, the bond search runs on the calling thread only.
+inline constexpr std::size_t BOND_THREAD_MIN_ATOMS = 16384;
+
+// Two atoms closer than the cutoff of their type pair. d is the vector
+// from atom i to atom j (minimum image if the box is periodic).
+struct Bond {
+  uint32_t i, j;
+  Vector3d d;
+};
+
+// Finds bonds with a linked-cell search: atoms are binned into cells at
+// least as large as the longest cutoff, so each atom is only compared with
+// the atoms of its own and the 26 surrounding cells.
+class BondSearch {
+public:
+  // Atoms of types t1 and t2 closer than rc are bonded (rc <= 0 removes the pair).
+  void set_cutoff(int t1, int t2, double rc) {
+    if (t1 < 0 || t2 < 0) return;
+    const int n = std::max({t1, t2, ntypes_ - 1}) + 1;
+    if (n > ntypes_) {
+      std::vector<double> c2(static_cast<std::size_t>(n) * n, 0.0);
+      for (int a = 0; a < ntypes_; a++) {
+        std::copy(cutoff2_.begin() + a * ntypes_, cutoff2_.begin() + (a + 1) * ntypes_, c2.begin() + a * n);
+      }
+      cutoff2_.swap(c2);
+      ntypes_ = n;
+    }
+    const double c2 = (rc > 0.0) ? rc * rc : 0.0;
+    cutoff2_[t1 * ntypes_ + t2] = c2;
+    cutoff2_[t2 * ntypes_ + t1] = c2;
+    rmax_ = 0.0;
+    for (double v : cutoff2_) {
+      rmax_ = std::max(rmax_, std::sqrt(v));
+    }
+  }
+
+  bool enabled() const {
+    return rmax_ > 0.0;
+  }
+
+  // With periodic boundaries, bonds are also found across the faces of the
+  // box given to find(). On by default.
+  void set_periodic(bool periodic) {
+    periodic_ = periodic;
+  }
+
+  // Finds the bonds between atoms with use[i] set. The box [lo, hi] is
+  // only used if periodic; otherwise the bounds of the atoms are.
+  const std::vector<Bond> &find(const std::vector<Vector3d> &pos, const std::vector<int> &type,
+                                const std::vector<char> &use, const Vector3d &lo, const Vector3d &hi) {
+    bonds_.clear();
+    if (!enabled() || pos.empty()) return bonds_;
+    len_ = hi - lo;
+    wrapped_.resize(pos.size());
+    Vector3d glo = lo, ghi = hi;
+    if (periodic_) {
+      for (std::size_t i = 0; i < pos.size(); i++) {
+        wrapped_[i] = Vector3d(wrap(pos[i].x, lo.x, len_.x), wrap(pos[i].y, lo.y, len_.y), wrap(pos[i].z, lo.z, len_.z));
+      }
+    } else {
+      glo = Vector3d(1e300, 1e300, 1e300);
+      ghi = Vector3d(-1e300, -1e300, -1e300);
+      for (std::size_t i = 0; i < pos.size(); i++) {
+        wrapped_[i] = pos[i];
+        glo = Vector3d(std::min(glo.x, pos[i].x), std::min(glo.y, pos[i].y), std::min(glo.z, pos[i].z));
+        ghi = Vector3d(std::max(ghi.x, pos[i].x), std::max(ghi.y, pos[i].y), std::max(ghi.z, pos[i].z));
+      }
+    }
+    // Cells no smaller than the longest cutoff, and not many more cells
+    // than atoms when the cutoff is short compared to the box.
+    const double cell = std::max(rmax_, CellGrid::cell_size_for(glo, ghi, pos.size(), 1.0));
+    grid_.build(wrapped_, glo, ghi, cell);
+    // Copy positions and types into cell order, so that the atoms of a cell
+    // are contiguous in memory during the search. Unused atoms get type -1.
+    const auto &idx = grid_.indices();
+    sorted_pos_.resize(pos.size());
+    sorted_type_.resize(pos.size());
+    for (std::size_t a = 0; a < pos.size(); a++) {
+      const std::size_t i = idx[a];
+      sorted_pos_[a] = wrapped_[i];
+      sorted_type_[a] = (use[i] && type[i] < ntypes_) ? type[i] : -1;
+    }
+
+    const std::size_t ncell = grid_.num_cells();
+    unsigned nthreads = 1;
+    if (pos.size() >= BOND_THREAD_MIN_ATOMS) {
+      nthreads = std::max(1u, std::min(std::thread::hardware_concurrency(), 64u));
+    }
+    parts_.resize(nthreads);
+    auto work = [&](unsigned k) {
+      parts_[k].clear();
+      search(ncell * k / nthreads, ncell * (k + 1) / nthreads, parts_[k]);
+    };
+    if (nthreads == 1) {
+      work(0);
+    } else {
+      std::vector<std::thread> threads;
+      for (unsigned k = 1; k < nthreads; k++) {
+        threads.emplace_back(work, k);
+      }
+      work(0);
+      for (auto &t : threads) {
+        t.join();
+      }
+    }
+    for (const auto &part : parts_) {
+      bonds_.insert(bonds_.end(), part.begin(), part.end());
+    }
+    return bonds_;
+  }
+
+private:
+  int ntypes_ = 0;
+  std::vector<double> cutoff2_; // ntypes_ x ntypes_, 0 for pairs without bonds
+  double rmax_ = 0.0;
+  bool periodic_ = true;
+  Vector3d len_;
+  CellGrid grid_;
+  std::vector<Vector3d> wrapped_;
+  std::vector<Vector3d> sorted_pos_; // In cell order (grid_.indices())
+  std::vector<int> sorted_type_;
+  std::vector<std::vector<Bond>> parts_; // Per thread, concatenated in order
+  std::vector<Bond> bonds_;
+
+  static double wrap(double v, double lo, double len) {
+    if (!(len > 0.0)) return v;
+    const double f = std::floor((v - lo) / len);
+    return v - f * len;
+  }
+
+  static double minimum_image(double d, double len) {
+    if (!(len > 0.0)) return d;
+    return d - len * std::round(d / len);
+  }
+
+  // Neighbor cells of c along one axis, without duplicates when the grid
+  // has fewer than three cells along it. Returns the number of cells.
+  int neighbors(int c, int n, int out[3]) const {
+    int k = 0;
+    for (int o = -1; o <= 1; o++) {
+      int v = c + o;
+      if (periodic_) {
+        v = (v + n) % n;
+      } else if (v < 0 || v >= n) {
+        continue;
+      }
+      if (std::find(out, out + k, v) == out + k) out[k++] = v;
+    }
+    return k;
+  }
+
+  // Appends the bonds of the atoms in cells [c1, c2) to out. A pair is
+  // reported by the atom which comes first in cell order, so every bond
+  // appears once.
+  void search(std::size_t c1, std::size_t c2, std::vector<Bond> &out) const {
+    const auto &idx = grid_.indices();
+    const int nx = grid_.nx(), ny = grid_.ny(), nz = grid_.nz();
+    int xs[3], ys[3], zs[3];
+    std::size_t cells[27];
+    for (std::size_t c = c1; c < c2; c++) {
+      const int ix = static_cast<int>(c % nx);
+      const int iy = static_cast<int>(c / nx % ny);
+      const int iz = static_cast<int>(c / nx / ny);
+      const int kx = neighbors(ix, nx, xs), ky = neighbors(iy, ny, ys), kz = neighbors(iz, nz, zs);
+      int ncells = 0;
+      for (int z = 0; z < kz; z++)
+        for (int y = 0; y < ky; y++)
+          for (int x = 0; x < kx; x++)
+            cells[ncells++] = grid_.index(xs[x], ys[y], zs[z]);
+      for (std::size_t a = grid_.cell_begin(c); a < grid_.cell_begin(c + 1); a++) {
+        const int ti = sorted_type_[a];
+        if (ti < 0) continue;
+        const double *row = &cutoff2_[ti * ntypes_];
+        const Vector3d pa = sorted_pos_[a];
+        for (int k = 0; k < ncells; k++) {
+          const std::size_t b2 = grid_.cell_begin(cells[k] + 1);
+          for (std::size_t b = std::max(grid_.cell_begin(cells[k]), a + 1); b < b2; b++) {
+            const int tj = sorted_type_[b];
+            if (tj < 0 || row[tj] <= 0.0) continue;
+            Vector3d d = sorted_pos_[b] - pa;
+            if (periodic_) {
+              d = Vector3d(minimum_image(d.x, len_.x), minimum_image(d.y, len_.y), minimum_image(d.z, len_.z));
+            }
+            if (d.norm2() < row[tj]) {
+              out.push_back({static_cast<uint32_t>(idx[a]), static_cast<uint32_t>(idx[b]), d});
+            }
+          }
+        }
+      }
+    }
+  }
+};
+
+} // namespace trj_render
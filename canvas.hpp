@@ -1,8 +1,12 @@
 #pragma once
 
 #include "vector3d.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <lodepng.h>
 #include <vector>
 namespace trj_render {
@@ -16,9 +20,27 @@ private:
   int width, height, line;
   int cx, cy;            // Current Point
   unsigned char R, G, B; // Current Color
+  int pen;               // Line width in pixels
+  bool depth_test;       // Compare and write depth_buffer while drawing
+  float D;               // Current Depth (larger is nearer)
+  int ox, oy;            // Position in the full image (set_origin)
+
+  void plot(int x, int y) {
+    if (pen == 1) {
+      draw_point(x, y);
+      return;
+    }
+    const int o = (pen - 1) / 2;
+    for (int iy = 0; iy < pen; iy++) {
+      for (int ix = 0; ix < pen; ix++) {
+        draw_point(x - o + ix, y - o + iy);
+      }
+    }
+  }
 
 public:
   std::vector<unsigned char> image_buffer;
+  std::vector<float> depth_buffer; // Empty unless enable_depth() was called
   Canvas(int w, int h) {
     width = w;
     height = h;
@@ -26,11 +48,64 @@ public:
     image_buffer.resize(w * h * 4, 255);
     cx = 0;
     cy = 0;
+    pen = 1;
+    depth_test = false;
+    D = 0.0f;
+    ox = 0;
+    oy = 0;
+  }
+
+  // Places this canvas at pixel (x, y) of a larger image, e.g. as one tile
+  // of it. Coordinates stay local to the canvas, but are truncated to
+  // pixels as the full image truncates them, so that tiles line up with a
+  // render of the whole image.
+  void set_origin(int x, int y) {
+    ox = x;
+    oy = y;
+  }
+
+  int pixel_x(double x) const {
+    return static_cast<int>(x + ox) - ox;
+  }
+
+  int pixel_y(double y) const {
+    return static_cast<int>(y + oy) - oy;
+  }
+
+  // Allocates a depth buffer and turns the depth test on. Later drawing
+  // only touches pixels whose stored depth is not nearer than the current one.
+  void enable_depth() {
+    depth_buffer.assign(static_cast<std::size_t>(width) * height, -std::numeric_limits<float>::infinity());
+    depth_test = true;
+  }
+
+  void set_depth_test(bool on) {
+    depth_test = on && !depth_buffer.empty();
+  }
+
+  bool depth_test_enabled() const {
+    return depth_test;
+  }
+
+  void set_depth(double d) {
+    D = static_cast<float>(d);
+  }
+
+  int get_width() const {
+    return width;
+  }
+
+  int get_height() const {
+    return height;
+  }
+
+  void set_line_width(int w) {
+    pen = std::max(1, w);
   }
 
   void moveto(const trj_render::Vector2d &v) {
-    int ix = static_cast<int>(v.x);
-    int iy = static_cast<int>(v.y);
+    int ix = pixel_x(v.x);
+    int iy = pixel_y(v.y);
     moveto(ix, iy);
   }
 
@@ -40,8 +115,8 @@ public:
   }
 
   void lineto(const trj_render::Vector2d &v) {
-    int ix = static_cast<int>(v.x);
-    int iy = static_cast<int>(v.y);
+    int ix = pixel_x(v.x);
+    int iy = pixel_y(v.y);
     lineto(ix, iy);
   }
 
@@ -55,7 +130,7 @@ public:
     if (dx > dy) {
       int E = -dx;
       for (int i = 0; i <= dx; i++) {
-        draw_point(cx, cy);
+        plot(cx, cy);
         cx += sx;
         E += 2 * dy;
         if (E >= 0) {
@@ -66,7 +141,7 @@ public:
     } else {
       int E = -dy;
       for (int i = 0; i <= dy; i++) {
-        draw_point(cx, cy);
+        plot(cx, cy);
         cy += sy;
         E += 2 * dx;
         if (E >= 0) {
@@ -82,6 +157,12 @@ public:
       return;
     if (y < 0 || y >= height)
       return;
+    if (depth_test) {
+      float &z = depth_buffer[y * width + x];
+      if (D < z)
+        return;
+      z = D;
+    }
     int p = y * line + x * 4;
     image_buffer[p] = R;
     image_buffer[p + 1] = G;
@@ -137,6 +218,46 @@ public:
     }
   }
 
+  void fill_span(int x1, int x2, int y) {
+    if (y < 0 || y >= height)
+      return;
+    x1 = std::max(x1, 0);
+    x2 = std::min(x2, width - 1);
+    if (depth_test) {
+      for (int x = x1; x <= x2; x++) {
+        draw_point(x, y);
+      }
+      return;
+    }
+    unsigned char *p = image_buffer.data() + y * line + x1 * 4;
+    for (int x = x1; x <= x2; x++, p += 4) {
+      p[0] = R;
+      p[1] = G;
+      p[2] = B;
+    }
+  }
+
+  // Fills every pixel whose center lies inside the circle.
+  // Unlike fill_circle(int, int, int), the center and the radius are not
+  // truncated, so the disc moves smoothly with subpixel displacements.
+  void fill_circle(double x0, double y0, double r) {
+    if (r <= 0.0)
+      return;
+    const int iy1 = static_cast<int>(std::ceil(y0 - r - 0.5));
+    const int iy2 = static_cast<int>(std::floor(y0 + r - 0.5));
+    for (int iy = std::max(iy1, 0); iy <= std::min(iy2, height - 1); iy++) {
+      const double dy = iy + 0.5 - y0;
+      const double d2 = r * r - dy * dy;
+      if (d2 < 0.0)
+        continue;
+      const double hw = std::sqrt(d2);
+      const int ix1 = static_cast<int>(std::ceil(x0 - hw - 0.5));
+      const int ix2 = static_cast<int>(std::floor(x0 + hw - 0.5));
+      if (ix1 <= ix2)
+        fill_span(ix1, ix2, iy);
+    }
+  }
+
   void draw_circle(int x0, int y0, int r) {
     int x = r;
     int y = 0;
@@ -159,8 +280,59 @@ public:
     }
   }
 
-  void save(const char *filename) {
-    lodepng::encode(filename, image_buffer, width, height);
+  // Box-filters the canvas by n x n pixels (n <= 16).
+  // Rows are first summed into 16-bit accumulators with a plain loop over
+  // the whole scanline so that the compiler can vectorize it, then each
+  // group of n pixels is reduced and divided by a multiply-shift.
+  Canvas downsample(int n) const {
+    if (n <= 1)
+      return *this;
+    const int w = width / n;
+    const int h = height / n;
+    Canvas out(w, h);
+    const std::size_t len = static_cast<std::size_t>(w) * n * 4;
+    const uint32_t area = n * n;
+    const uint32_t inv = ((1u << 24) + area - 1) / area;
+    std::vector<uint16_t> acc(len);
+    for (int oy = 0; oy < h; oy++) {
+      std::fill(acc.begin(), acc.end(), 0);
+      for (int k = 0; k < n; k++) {
+        const unsigned char *src = image_buffer.data() + (oy * n + k) * line;
+        for (std::size_t i = 0; i < len; i++) {
+          acc[i] += src[i];
+        }
+      }
+      unsigned char *dst = out.image_buffer.data() + oy * out.line;
+      if (n == 2) {
+        for (int i = 0; i < w * 4; i++) {
+          const int q = i >> 2, c = i & 3;
+          const uint32_t sum = acc[q * 8 + c] + acc[q * 8 + 4 + c];
+          dst[i] = static_cast<unsigned char>(((sum + 2) * inv) >> 24);
+        }
+        continue;
+      }
+      for (int ox = 0; ox < w; ox++) {
+        for (int c = 0; c < 4; c++) {
+          uint32_t sum = 0;
+          for (int j = 0; j < n; j++) {
+            sum += acc[(ox * n + j) * 4 + c];
+          }
+          dst[ox * 4 + c] = static_cast<unsigned char>(((sum + area / 2) * inv) >> 24);
+        }
+      }
+    }
+    return out;
+  }
+
+  std::vector<unsigned char> encode() const {
+    std::vector<unsigned char> png;
+    lodepng::encode(png, image_buffer, width, height);
+    return png;
+  }
+
+  // Returns false if the file could not be written.
+  bool save(const char *filename) {
+    return lodepng::encode(filename, image_buffer, width, height) == 0;
   }
 };
 } // namespace trj_render
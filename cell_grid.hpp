@@ -0,0 +1,102 @@
+#pragma once
+#include "vector3d.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace trj_render {
+
+// Uniform grid of cells over a set of points, built with one counting sort.
+// Indices of the points in cell c are
+// indices()[cell_begin(c)] ... indices()[cell_begin(c + 1) - 1].
+class CellGrid {
+public:
+  // Builds the grid over [lo, hi] with cells of (about) the given edge length.
+  // Points outside [lo, hi] are put into the nearest boundary cell.
+  void build(const std::vector<Vector3d> &pos, const Vector3d &lo, const Vector3d &hi, double cell_size) {
+    lo_ = lo;
+    const Vector3d len = hi - lo;
+    n_[0] = divisions(len.x, cell_size);
+    n_[1] = divisions(len.y, cell_size);
+    n_[2] = divisions(len.z, cell_size);
+    size_ = Vector3d(len.x / n_[0], len.y / n_[1], len.z / n_[2]);
+    const std::size_t ncell = num_cells();
+
+    cell_of_.resize(pos.size());
+    begin_.assign(ncell + 1, 0);
+    for (std::size_t i = 0; i < pos.size(); i++) {
+      const uint32_t c = static_cast<uint32_t>(index(cell_coord(pos[i].x, 0), cell_coord(pos[i].y, 1), cell_coord(pos[i].z, 2)));
+      cell_of_[i] = c;
+      begin_[c + 1]++;
+    }
+    for (std::size_t c = 0; c < ncell; c++) {
+      begin_[c + 1] += begin_[c];
+    }
+    indices_.resize(pos.size());
+    fill_.assign(begin_.begin(), begin_.end() - 1);
+    for (std::size_t i = 0; i < pos.size(); i++) {
+      indices_[fill_[cell_of_[i]]++] = i;
+    }
+  }
+
+  // Chooses the cell size so that a cell holds about `per_cell` points on
+  // average. Axes of zero extent are left out, since they get one cell.
+  static double cell_size_for(const Vector3d &lo, const Vector3d &hi, std::size_t n, double per_cell = 8.0) {
+    const Vector3d len = hi - lo;
+    double volume = 1.0;
+    int dims = 0;
+    for (double l : {len.x, len.y, len.z}) {
+      if (l > 0.0) {
+        volume *= l;
+        dims++;
+      }
+    }
+    if (dims == 0) return 1.0;
+    return std::pow(volume * per_cell / std::max<std::size_t>(n, 1), 1.0 / dims);
+  }
+
+  int nx() const { return n_[0]; }
+  int ny() const { return n_[1]; }
+  int nz() const { return n_[2]; }
+  std::size_t num_cells() const {
+    return static_cast<std::size_t>(n_[0]) * n_[1] * n_[2];
+  }
+  const Vector3d &cell_size() const {
+    return size_;
+  }
+  std::size_t index(int ix, int iy, int iz) const {
+    return (static_cast<std::size_t>(iz) * n_[1] + iy) * n_[0] + ix;
+  }
+  std::size_t cell_begin(std::size_t c) const {
+    return begin_[c];
+  }
+  const std::vector<std::size_t> &indices() const {
+    return indices_;
+  }
+
+  // Cell containing coordinate v along axis (0, 1, 2), clamped to the grid.
+  int cell_coord(double v, int axis) const {
+    const double o = (axis == 0) ? lo_.x : (axis == 1) ? lo_.y : lo_.z;
+    const double s = (axis == 0) ? size_.x : (axis == 1) ? size_.y : size_.z;
+    if (!(s > 0.0)) return 0; // Zero extent: a single cell
+    const double f = std::floor((v - o) / s);
+    if (!(f > 0.0)) return 0;
+    return static_cast<int>(std::min(f, static_cast<double>(n_[axis] - 1)));
+  }
+
+private:
+  Vector3d lo_, size_;
+  int n_[3] = {1, 1, 1};
+  std::vector<uint32_t> cell_of_;
+  std::vector<std::size_t> begin_, fill_;
+  std::vector<std::size_t> indices_;
+
+  static int divisions(double len, double cell_size) {
+    if (!(len > 0.0) || !(cell_size > 0.0)) return 1;
+    return std::clamp(static_cast<int>(len / cell_size), 1, 1024);
+  }
+};
+
+} // namespace trj_render
@@ -0,0 +1,76 @@
+#pragma once
+#include "canvas.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace trj_render {
+
+// Maps scalar values to colors through a precomputed lookup table, so that
+// coloring an atom costs one multiply-add and one table load.
+class ColorMap {
+public:
+  static constexpr int SIZE = 4096;
+
+  ColorMap() {
+    build("viridis");
+  }
+
+  // Known names: viridis, jet, coolwarm, gray. Returns false for others.
+  bool build(const std::string &name) {
+    static const std::array<Color, 9> viridis = {{{68, 1, 84}, {71, 44, 122}, {59, 81, 139}, {44, 113, 142}, {33, 144, 141}, {39, 173, 129}, {92, 200, 99}, {170, 220, 50}, {253, 231, 37}}};
+    static const std::array<Color, 5> jet = {{{0, 0, 143}, {0, 128, 255}, {128, 255, 128}, {255, 128, 0}, {128, 0, 0}}};
+    static const std::array<Color, 3> coolwarm = {{{59, 76, 192}, {221, 221, 221}, {180, 4, 38}}};
+    static const std::array<Color, 2> gray = {{{0, 0, 0}, {255, 255, 255}}};
+    if (name == "viridis") {
+      fill(viridis.data(), viridis.size());
+    } else if (name == "jet") {
+      fill(jet.data(), jet.size());
+    } else if (name == "coolwarm") {
+      fill(coolwarm.data(), coolwarm.size());
+    } else if (name == "gray") {
+      fill(gray.data(), gray.size());
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // Values at or below vmin get the first color, at or above vmax the last.
+  void set_range(double vmin, double vmax) {
+    vmin_ = vmin;
+    const double span = vmax - vmin;
+    scale_ = (span > 0.0) ? (SIZE - 1) / span : 0.0;
+  }
+
+  // Clamped in double before the conversion, so that values far out of
+  // range (or infinite) cannot overflow int. NaN gets the first color.
+  Color operator()(double v) const {
+    const double f = std::clamp((v - vmin_) * scale_, 0.0, SIZE - 1.0);
+    const int i = (f > 0.0) ? static_cast<int>(f + 0.5) : 0;
+    return lut_[i];
+  }
+
+private:
+  std::vector<Color> lut_;
+  double vmin_ = 0.0;
+  double scale_ = 0.0;
+
+  // Piecewise-linear interpolation between n equally spaced control colors.
+  void fill(const Color *c, std::size_t n) {
+    lut_.resize(SIZE);
+    for (int i = 0; i < SIZE; i++) {
+      const double t = static_cast<double>(i) / (SIZE - 1) * (n - 1);
+      const std::size_t k = std::min(static_cast<std::size_t>(t), n - 2);
+      const double u = t - k;
+      auto mix = [u](unsigned char a, unsigned char b) {
+        return static_cast<unsigned char>(std::lround(a + (b - a) * u));
+      };
+      lut_[i] = {mix(c[k].r, c[k + 1].r), mix(c[k].g, c[k + 1].g), mix(c[k].b, c[k + 1].b)};
+    }
+  }
+};
+
+} // namespace trj_render
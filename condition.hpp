@@ -1,5 +1,6 @@
 #pragma once
 #include "vector3d.hpp"
+#include <algorithm>
 #include <lammpstrj/lammpstrj.hpp>
 
 namespace trj_render {
@@ -8,6 +9,11 @@ class Condition {
 public:
   virtual ~Condition() = default;
   virtual bool check(lammpstrj::Atom &atom) = 0;
+  // Narrows [lo, hi] to the region which can pass this condition.
+  virtual void clip(Vector3d &lo, Vector3d &hi) const {
+    (void)lo;
+    (void)hi;
+  }
 };
 
 class XMinCondition : public Condition {
@@ -16,6 +22,9 @@ public:
   bool check(lammpstrj::Atom &atom) override {
     return atom.x > x_min_;
   }
+  void clip(Vector3d &lo, Vector3d &) const override {
+    lo.x = std::max(lo.x, x_min_);
+  }
 
 private:
   double x_min_;
@@ -27,6 +36,9 @@ public:
   bool check(lammpstrj::Atom &atom) override {
     return atom.x < x_max_;
   }
+  void clip(Vector3d &, Vector3d &hi) const override {
+    hi.x = std::min(hi.x, x_max_);
+  }
 
 private:
   double x_max_;
@@ -38,6 +50,9 @@ public:
   bool check(lammpstrj::Atom &atom) override {
     return atom.y > y_min_;
   }
+  void clip(Vector3d &lo, Vector3d &) const override {
+    lo.y = std::max(lo.y, y_min_);
+  }
 
 private:
   double y_min_;
@@ -49,6 +64,9 @@ public:
   bool check(lammpstrj::Atom &atom) override {
     return atom.y < y_max_;
   }
+  void clip(Vector3d &, Vector3d &hi) const override {
+    hi.y = std::min(hi.y, y_max_);
+  }
 
 private:
   double y_max_;
@@ -60,6 +78,9 @@ public:
   bool check(lammpstrj::Atom &atom) override {
     return atom.z > z_min_;
   }
+  void clip(Vector3d &lo, Vector3d &) const override {
+    lo.z = std::max(lo.z, z_min_);
+  }
 
 private:
   double z_min_;
@@ -71,6 +92,9 @@ public:
   bool check(lammpstrj::Atom &atom) override {
     return atom.z < z_max_;
   }
+  void clip(Vector3d &, Vector3d &hi) const override {
+    hi.z = std::min(hi.z, z_max_);
+  }
 
 private:
   double z_max_;
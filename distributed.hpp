@@ -0,0 +1,231 @@
+#pragma once
+#include "renderer.hpp"
+#include "trajectory.hpp"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#ifdef TRJ_RENDER_MPI
+#include <mpi.h>
+#endif
+
+namespace trj_render {
+
+// What one rank did; gathered by rank 0.
+struct RenderStats {
+  int rank;
+  int frames;
+  std::int64_t atoms;
+  double seconds;
+  int failed; // Nonzero if an output file could not be written
+};
+
+// Splits frames into nparts contiguous ranges with about the same number of
+// atoms each. Part k renders frames [bounds[k], bounds[k + 1]).
+inline std::vector<std::size_t> partition_by_atoms(const std::vector<FrameEntry> &frames, int nparts) {
+  double total = 0.0;
+  for (const auto &f : frames) {
+    total += static_cast<double>(f.atoms) + 1.0;
+  }
+  std::vector<std::size_t> bounds(nparts + 1, frames.size());
+  bounds[0] = 0;
+  double acc = 0.0;
+  int part = 0;
+  for (std::size_t i = 0; i < frames.size(); i++) {
+    // A frame belongs to the part in which its midpoint (in atoms) falls.
+    const double w = static_cast<double>(frames[i].atoms) + 1.0;
+    const int p = std::min(nparts - 1, static_cast<int>((acc + 0.5 * w) * nparts / total));
+    while (part < p) {
+      bounds[++part] = i;
+    }
+    acc += w;
+  }
+  return bounds;
+}
+
+// Draws a frame colored by `column` if the frame had it, and by type with a
+// warning otherwise. Returns false if the output could not be written.
+inline bool draw_frame_with(Renderer &renderer, const std::unique_ptr<lammpstrj::SystemInfo> &si,
+                            std::vector<lammpstrj::Atom> &atoms, const ScalarColumn *column) {
+  if (column && !column->found) {
+    std::cerr << "Warning: column " << column->name << " not found in frame " << si->frame_index
+              << "; coloring by type." << std::endl;
+  }
+  const bool found = column && column->found;
+  renderer.set_scalar(found ? column->values.data() : nullptr, found ? column->min : 0.0, found ? column->max : 0.0);
+  const bool ok = renderer.draw_frame(si, atoms);
+  renderer.set_scalar(nullptr, 0.0, 0.0);
+  return ok;
+}
+
+// Renders frames[first, last), seeking to each one, together with the
+// column the renderer colors by, if any. Stops at the first frame that
+// could not be read or written.
+inline RenderStats render_frames(Renderer &renderer, const std::string &filename,
+                                 const std::vector<FrameEntry> &frames, std::size_t first, std::size_t last, int rank) {
+  const auto start = std::chrono::steady_clock::now();
+  RenderStats stats{rank, 0, 0, 0.0, 0};
+  std::vector<lammpstrj::Atom> atoms;
+  ScalarColumn column;
+  column.name = renderer.color_by();
+  ScalarColumn *col = column.name.empty() ? nullptr : &column;
+  for (std::size_t i = first; i < last; i++) {
+    auto si = read_frame_at(filename, frames[i], atoms, col);
+    if (!si) {
+      std::cerr << "Error: could not read frame " << frames[i].index << std::endl;
+      stats.failed = 1;
+      break;
+    }
+    if (!draw_frame_with(renderer, si, atoms, col)) {
+      stats.failed = 1;
+      break;
+    }
+    stats.frames++;
+    stats.atoms += frames[i].atoms;
+  }
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return stats;
+}
+
+// Renders all frames in order, or only frame `frame_index` if it is not
+// negative, with the column the renderer colors by. The file is read once
+// from the start, without scan_frames(); frames before frame_index only
+// have their headers parsed. Returns false if a frame was missing or could
+// not be written.
+inline bool render_sequential(Renderer &renderer, const std::string &filename, int frame_index) {
+  ChunkReader reader(filename);
+  std::vector<lammpstrj::Atom> atoms;
+  ScalarColumn column;
+  column.name = renderer.color_by();
+  ScalarColumn *col = column.name.empty() ? nullptr : &column;
+  for (int index = 0; reader.good(); index++) {
+    if (index < frame_index) {
+      if (!skip_frame(reader)) break;
+      continue;
+    }
+    auto si = read_frame(reader, atoms, col);
+    if (!si) break;
+    si->frame_index = index;
+    if (!draw_frame_with(renderer, si, atoms, col)) return false;
+    if (frame_index >= 0) return true;
+  }
+  if (frame_index >= 0) {
+    std::cerr << "Error: frame " << frame_index << " not found." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Returns false if any rank failed.
+inline bool print_stats(const std::vector<RenderStats> &all) {
+  int frames = 0;
+  bool ok = true;
+  std::int64_t atoms = 0;
+  double tmax = 0.0, tsum = 0.0;
+  for (const auto &s : all) {
+    std::cout << "rank " << s.rank << ": " << s.frames << " frames, " << s.atoms << " atoms, "
+              << s.seconds << " s" << (s.failed ? " (failed)" : "") << std::endl;
+    ok = ok && !s.failed;
+    frames += s.frames;
+    atoms += s.atoms;
+    tmax = std::max(tmax, s.seconds);
+    tsum += s.seconds;
+  }
+  std::cout << "total: " << frames << " frames, " << atoms << " atoms, " << tmax << " s";
+  if (tsum > 0.0) {
+    std::cout << " (imbalance " << tmax * all.size() / tsum << ")";
+  }
+  std::cout << std::endl;
+  return ok;
+}
+
+// Local stand-in for MPI: forks nprocs - 1 workers, each rendering its share
+// of the frames, while the parent renders share 0 and gathers the stats
+// through pipes. Returns false if any output could not be written.
+inline bool render_forked(Renderer &renderer, const std::string &filename, int nprocs) {
+  const auto frames = scan_frames(filename);
+  const auto bounds = partition_by_atoms(frames, nprocs);
+  std::cout.flush();
+  std::vector<int> fds;
+  std::vector<pid_t> pids;
+  for (int rank = 1; rank < nprocs; rank++) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+      std::perror("pipe");
+      break;
+    }
+    const pid_t pid = fork();
+    if (pid < 0) {
+      std::perror("fork");
+      close(fd[0]);
+      close(fd[1]);
+      break;
+    }
+    if (pid == 0) {
+      close(fd[0]);
+      RenderStats s = render_frames(renderer, filename, frames, bounds[rank], bounds[rank + 1], rank);
+      std::cout.flush();
+      const bool ok = write(fd[1], &s, sizeof(s)) == static_cast<ssize_t>(sizeof(s));
+      close(fd[1]);
+      _exit(ok && !s.failed ? 0 : 1);
+    }
+    close(fd[1]);
+    fds.push_back(fd[0]);
+    pids.push_back(pid);
+  }
+  std::vector<RenderStats> all{render_frames(renderer, filename, frames, bounds[0], bounds[1], 0)};
+  // Shares of workers which could not be started are rendered here.
+  const std::size_t started = fds.size() + 1;
+  if (started < static_cast<std::size_t>(nprocs)) {
+    RenderStats rest = render_frames(renderer, filename, frames, bounds[started], bounds[nprocs], 0);
+    all[0].frames += rest.frames;
+    all[0].atoms += rest.atoms;
+    all[0].seconds += rest.seconds;
+    all[0].failed |= rest.failed;
+  }
+  for (std::size_t k = 0; k < fds.size(); k++) {
+    RenderStats s{};
+    if (read(fds[k], &s, sizeof(s)) != static_cast<ssize_t>(sizeof(s))) {
+      s = RenderStats{static_cast<int>(k) + 1, 0, 0, 0.0, 1};
+      std::cerr << "Error: rank " << k + 1 << " did not report" << std::endl;
+    }
+    close(fds[k]);
+    waitpid(pids[k], nullptr, 0);
+    all.push_back(s);
+  }
+  return print_stats(all);
+}
+
+#ifdef TRJ_RENDER_MPI
+// Rank 0 scans the file and broadcasts the frame index; every rank renders
+// its share, reading only its own byte ranges, and rank 0 gathers the stats.
+// Returns false on a rank whose output could not be written, and on rank 0
+// if any rank failed.
+inline bool render_mpi(Renderer &renderer, const std::string &filename) {
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  std::vector<FrameEntry> frames;
+  if (rank == 0) {
+    frames = scan_frames(filename);
+  }
+  unsigned long long n = frames.size();
+  MPI_Bcast(&n, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+  frames.resize(n);
+  MPI_Bcast(frames.data(), static_cast<int>(n * sizeof(FrameEntry)), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+  const auto bounds = partition_by_atoms(frames, size);
+  RenderStats s = render_frames(renderer, filename, frames, bounds[rank], bounds[rank + 1], rank);
+  std::vector<RenderStats> all(rank == 0 ? size : 0);
+  MPI_Gather(&s, sizeof(s), MPI_BYTE, all.data(), sizeof(s), MPI_BYTE, 0, MPI_COMM_WORLD);
+  if (rank == 0) {
+    return print_stats(all);
+  }
+  return !s.failed;
+}
+#endif
+
+} // namespace trj_render
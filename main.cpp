@@ -1,24 +1,58 @@
+#include "distributed.hpp"
 #include "renderer.hpp"
 #include <cstdio>
 #include <cxxopts.hpp>
 #include <lammpstrj/lammpstrj.hpp>
 
+// --radiusN and --visibleN are declared for types 0 ... NUMBERED_TYPE_OPTIONS - 1.
+// Any type can be given with --radius and --hide.
+constexpr int NUMBERED_TYPE_OPTIONS = 16;
+
+// Ends the program from anywhere after MPI_Init: in MPI builds, exiting
+// without MPI_Finalize is reported as an abnormal termination, so errors
+// abort all ranks and other exits finalize first.
+[[noreturn]] void quit(int status) {
+#ifdef TRJ_RENDER_MPI
+  if (status != 0) MPI_Abort(MPI_COMM_WORLD, status);
+  MPI_Finalize();
+#endif
+  std::exit(status);
+}
+
 auto parse_argument(int argc, char **argv) {
   cxxopts::Options options("trj2png", "Render LAMMPS .lammpstrj frames to PNG (2D projection).");
   options.add_options()("x,rx", "Rotation around X axis (degrees)", cxxopts::value<double>()->default_value("0"));
   options.add_options()("y,ry", "Rotation around Y axis (degrees)", cxxopts::value<double>()->default_value("0"));
   options.add_options()("z,rz", "Rotation around Z axis (degrees)", cxxopts::value<double>()->default_value("0"));
   options.add_options()("s,scale", "Scale factor for simulation box → pixels (if negative, the scale is automatically adjusted so that the larger side of the image becomes 800 pixels)", cxxopts::value<double>()->default_value("-1"));
+  options.add_options()("fov", "Perspective camera with this field of view in degrees (0 = orthographic)", cxxopts::value<double>()->default_value("0"));
+  options.add_options()("eye", "Distance of the perspective camera from the box center (default: keep the scale at the center)", cxxopts::value<double>()->default_value("0"));
+  options.add_options()("aa", "Antialiasing factor N: render at N times the resolution and downsample (1 = off, max 16)", cxxopts::value<int>()->default_value("1"));
+  options.add_options()("shade", "Draw atoms as shaded spheres lit by a directional light");
+  options.add_options()("static-types", "Comma-separated atom types which do not move; they are drawn once into a cached background layer", cxxopts::value<std::vector<int>>());
+  options.add_options()("static-ids", "Comma-separated atom IDs or ID ranges (e.g. 1-500,731) which do not move", cxxopts::value<std::vector<std::string>>());
+  options.add_options()("tile", "Write each frame as a DeepZoom tile pyramid with N x N pixel tiles instead of a single PNG (for images larger than memory)", cxxopts::value<int>()->default_value("0"));
+  options.add_options()("procs", "Render with N local processes; frames are split by atom count (ignored with -f and in MPI builds)", cxxopts::value<int>()->default_value("1"));
+  options.add_options()("radius", "Comma-separated radii of atom types as TYPE=RADIUS (e.g. 1=0.4,17=1.2)", cxxopts::value<std::vector<std::string>>());
+  options.add_options()("bond", "Comma-separated bond cutoffs as TYPE-TYPE=CUTOFF (e.g. 1-1=1.5,1-2=1.2); atoms closer than the cutoff are joined by a line", cxxopts::value<std::vector<std::string>>());
+  options.add_options()("bond-width", "Line width of bonds in pixels", cxxopts::value<int>()->default_value("1"));
+  options.add_options()("no-pbc", "Do not search bonds across the periodic boundaries of the box");
+  options.add_options()("hide", "Comma-separated atom types not to display", cxxopts::value<std::vector<int>>());
+  options.add_options()("color-by", "Color atoms by this per-atom column of the dump (e.g. vx, c_stress, q), or vmag for the velocity magnitude", cxxopts::value<std::string>());
+  options.add_options()("colormap", "Colormap for --color-by (viridis, jet, coolwarm, gray)", cxxopts::value<std::string>()->default_value("viridis"));
+  options.add_options()("color-min", "Value mapped to the first color of the colormap (default: per-frame minimum)", cxxopts::value<double>());
+  options.add_options()("color-max", "Value mapped to the last color of the colormap (default: per-frame maximum)", cxxopts::value<double>());
+  options.add_options()("o,output", "Prefix of output files (<prefix>.NNNN.png)", cxxopts::value<std::string>()->default_value("frame"));
   options.add_options()("f,frame", "Render only this frame index (0-based). If omitted, renderall.", cxxopts::value<int>()->default_value("-1"));
   options.add_options()("xmin", "Minimum x-coordinate to display", cxxopts::value<double>())("xmax", "Maximum x-coordinate to display", cxxopts::value<double>())("ymin", "Minimum y-coordinate to display", cxxopts::value<double>())("ymax", "Maximum y-coordinate to display", cxxopts::value<double>())("zmin", "Minimum z-coordinate to display", cxxopts::value<double>())("zmax", "Maximum z-coordinate to display", cxxopts::value<double>());
 
-  for (int i = 0; i < trj_render::MAX_ATOM_TYPES; ++i) {
+  for (int i = 0; i < NUMBERED_TYPE_OPTIONS; ++i) {
     std::string key = "radius" + std::to_string(i);
     std::string desc = "Radius of atom type " + std::to_string(i);
     options.add_options()(key, desc, cxxopts::value<double>());
   }
 
-  for (int i = 0; i < trj_render::MAX_ATOM_TYPES; ++i) {
+  for (int i = 0; i < NUMBERED_TYPE_OPTIONS; ++i) {
     std::string key = "visible" + std::to_string(i);
     std::string desc = "Visibility of atom type " + std::to_string(i) +
                        " (true to display, false to hide)";
@@ -31,18 +65,19 @@ auto parse_argument(int argc, char **argv) {
   auto result = options.parse(argc, argv);
   if (result.count("help")) {
     std::cout << options.help({"", "positional"}) << std::endl;
-    exit(0);
+    quit(0);
   }
 
   if (!result.count("filename")) {
     std::cerr << "Error: filename is required.\n\n"
               << options.help({"", "positional"}) << std::endl;
-    exit(1);
+    quit(1);
   }
   return result;
 }
 
-void read_lammpstrj(int argc, char **argv) {
+// Returns the exit status: 1 if an output file could not be written.
+int read_lammpstrj(int argc, char **argv) {
   auto result = parse_argument(argc, argv);
 
   const std::string filename = result["filename"].as<std::string>();
@@ -50,7 +85,7 @@ void read_lammpstrj(int argc, char **argv) {
   std::ifstream fin(filename.c_str());
   if (!fin.good()) {
     std::cerr << "Error: File not found: " << filename << std::endl;
-    std::exit(1);
+    quit(1);
   }
 
   const double rx_deg = result["rx"].as<double>();
@@ -67,7 +102,33 @@ void read_lammpstrj(int argc, char **argv) {
   proj.rotateY(ry_deg);
   proj.rotateZ(rz_deg);
   proj.setScale(scale);
+  proj.setPerspective(result["fov"].as<double>(), result["eye"].as<double>());
   trj_render::Renderer renderer(proj);
+  renderer.set_antialias(result["aa"].as<int>());
+  renderer.set_shading(result.count("shade") > 0);
+  renderer.set_tile_size(result["tile"].as<int>());
+  renderer.set_output_prefix(result["output"].as<std::string>());
+  if (result.count("static-types")) {
+    for (int t : result["static-types"].as<std::vector<int>>()) {
+      if (!renderer.add_static_type(t)) {
+        std::cerr << "Error: invalid atom type in --static-types: " << t << std::endl;
+        quit(1);
+      }
+    }
+  }
+  if (result.count("static-ids")) {
+    for (const auto &range : result["static-ids"].as<std::vector<std::string>>()) {
+      const auto dash = range.find('-', 1);
+      try {
+        const int id_min = std::stoi(range.substr(0, dash));
+        const int id_max = (dash == std::string::npos) ? id_min : std::stoi(range.substr(dash + 1));
+        renderer.add_static_ids(id_min, id_max);
+      } catch (const std::exception &) {
+        std::cerr << "Error: invalid ID range in --static-ids: " << range << std::endl;
+        quit(1);
+      }
+    }
+  }
   if (result.count("xmin")) {
     double xmin = result["xmin"].as<double>();
     renderer.add_condition(std::make_unique<trj_render::XMinCondition>(xmin));
@@ -93,7 +154,7 @@ void read_lammpstrj(int argc, char **argv) {
     renderer.add_condition(std::make_unique<trj_render::ZMaxCondition>(zmax));
   }
 
-  for (int i = 0; i < trj_render::MAX_ATOM_TYPES; ++i) {
+  for (int i = 0; i < NUMBERED_TYPE_OPTIONS; ++i) {
     std::string opt = "radius" + std::to_string(i);
     if (result.count(opt)) {
       double r = result[opt].as<double>();
@@ -101,7 +162,7 @@ void read_lammpstrj(int argc, char **argv) {
     }
   }
 
-  for (int i = 0; i < trj_render::MAX_ATOM_TYPES; ++i) {
+  for (int i = 0; i < NUMBERED_TYPE_OPTIONS; ++i) {
     std::string opt = "visible" + std::to_string(i);
     if (result.count(opt)) {
       bool visible = result[opt].as<bool>();
@@ -109,17 +170,93 @@ void read_lammpstrj(int argc, char **argv) {
     }
   }
 
+  if (result.count("radius")) {
+    for (const auto &item : result["radius"].as<std::vector<std::string>>()) {
+      const auto eq = item.find('=');
+      try {
+        if (eq == std::string::npos) throw std::invalid_argument(item);
+        if (!renderer.set_atom_radius(std::stoi(item.substr(0, eq)), std::stod(item.substr(eq + 1)))) {
+          throw std::invalid_argument(item);
+        }
+      } catch (const std::exception &) {
+        std::cerr << "Error: invalid --radius entry (expected TYPE=RADIUS, TYPE >= 0): " << item << std::endl;
+        quit(1);
+      }
+    }
+  }
+  if (result.count("bond")) {
+    for (const auto &item : result["bond"].as<std::vector<std::string>>()) {
+      const auto dash = item.find('-');
+      const auto eq = item.find('=');
+      try {
+        if (dash == std::string::npos || eq == std::string::npos || eq < dash) throw std::invalid_argument(item);
+        if (!renderer.set_bond(std::stoi(item.substr(0, dash)), std::stoi(item.substr(dash + 1, eq - dash - 1)),
+                               std::stod(item.substr(eq + 1)))) {
+          throw std::invalid_argument(item);
+        }
+      } catch (const std::exception &) {
+        std::cerr << "Error: invalid --bond entry (expected TYPE-TYPE=CUTOFF, TYPE >= 0): " << item << std::endl;
+        quit(1);
+      }
+    }
+  }
+  renderer.set_bond_width(result["bond-width"].as<int>());
+  renderer.set_periodic(result.count("no-pbc") == 0);
+
+  if (result.count("hide")) {
+    for (int t : result["hide"].as<std::vector<int>>()) {
+      if (t < 0) {
+        std::cerr << "Error: invalid atom type in --hide: " << t << std::endl;
+        quit(1);
+      }
+      renderer.add_condition(std::make_unique<trj_render::AtomTypeCondition>(t, false));
+    }
+  }
+
+  if (result.count("color-by")) {
+    renderer.set_color_by(result["color-by"].as<std::string>());
+    const std::string cmap = result["colormap"].as<std::string>();
+    if (!renderer.set_colormap(cmap)) {
+      std::cerr << "Error: unknown colormap: " << cmap << std::endl;
+      quit(1);
+    }
+    if (result.count("color-min") && result.count("color-max")) {
+      renderer.set_color_range(result["color-min"].as<double>(), result["color-max"].as<double>());
+    } else if (result.count("color-min") || result.count("color-max")) {
+      std::cerr << "Error: --color-min and --color-max must be given together." << std::endl;
+      quit(1);
+    }
+  }
+
+#ifdef TRJ_RENDER_MPI
   if (frame_index < 0) {
+    return trj_render::render_mpi(renderer, filename) ? 0 : 1;
+  }
+  // A single frame is rendered by rank 0 only, so ranks do not race on its file.
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank != 0) return 0;
+#endif
+  const int procs = result["procs"].as<int>();
+  bool ok = true;
+  if (frame_index < 0 && procs > 1) {
+    ok = trj_render::render_forked(renderer, filename, procs);
+  } else if (!renderer.color_by().empty()) {
+    // lammpstrj::Atom has no extra columns, so these frames are read by our
+    // own reader together with the column.
+    ok = trj_render::render_sequential(renderer, filename, frame_index);
+  } else if (frame_index < 0) {
     lammpstrj::for_each_frame(filename,
-                              [&renderer](const auto &si, auto &atoms) {
-                                renderer.draw_frame(si, atoms);
+                              [&renderer, &ok](const auto &si, auto &atoms) {
+                                if (ok) ok = renderer.draw_frame(si, atoms);
                               });
   } else {
     lammpstrj::for_frame(frame_index, filename,
-                         [&renderer](const auto &si, auto &atoms) {
-                           renderer.draw_frame(si, atoms);
+                         [&renderer, &ok](const auto &si, auto &atoms) {
+                           ok = renderer.draw_frame(si, atoms);
                          });
   }
+  return ok ? 0 : 1;
 }
 
 void test() {
@@ -156,6 +293,13 @@ void test() {
 }
 
 int main(int argc, char **argv) {
-  read_lammpstrj(argc, argv);
+#ifdef TRJ_RENDER_MPI
+  MPI_Init(&argc, &argv);
+#endif
+  const int status = read_lammpstrj(argc, argv);
+#ifdef TRJ_RENDER_MPI
+  MPI_Finalize();
+#endif
   // test();
+  return status;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <array>
 #include <cmath>
 #include <lammpstrj/lammpstrj.hpp>
+#include <limits>
 #include <utility>
 
 namespace trj_render {
@@ -39,6 +40,24 @@ struct Mat3d {
   }
 };
 
+struct Mat4d {
+  double m[4][4];
+  friend Mat4d operator*(const Mat4d &A, const Mat4d &B) {
+    Mat4d C{};
+    for (int i = 0; i < 4; ++i)
+      for (int j = 0; j < 4; ++j)
+        C.m[i][j] = A.m[i][0] * B.m[0][j] + A.m[i][1] * B.m[1][j] + A.m[i][2] * B.m[2][j] + A.m[i][3] * B.m[3][j];
+    return C;
+  }
+};
+
+// Screen position, depth (larger is nearer) and pixels per length unit at
+// that depth. scale is 0 for points behind the near plane of a perspective
+// view (including those behind the eye), which must not be drawn.
+struct Projected {
+  double x, y, depth, scale;
+};
+
 class Projector {
 public:
   Projector(const Vector3d &bmin, const Vector3d &bmax, double scale = 1.0)
@@ -46,46 +65,76 @@ public:
     center_.x = 0.5 * (bmin_.x + bmax_.x);
     center_.y = 0.5 * (bmin_.y + bmax_.y);
     center_.z = 0.5 * (bmin_.z + bmax_.z);
+    update_();
   }
 
   void resetRotation() {
     R_ = Mat3d::identity();
+    update_();
   }
 
   void setScale(double s) {
     if (s > 0.0) {
       scale_ = s;
+      update_();
       return;
     }
 
-    Bounds2D b = bounds2d_unscaled_();
+    const Bounds2D &b = bounds_;
     double w = (b.max_y - b.min_y);
     double h = (b.max_z - b.min_z);
     double max_len = std::max(w, h);
 
     if (max_len < 1e-12) {
       scale_ = 1.0;
+      update_();
       return;
     }
 
     scale_ = 800.0 / max_len;
+    update_();
   }
 
   double scale() const {
     return scale_;
   }
 
+  // Shifts screen coordinates so that pixel (ox, oy) of the full image
+  // becomes the origin, e.g. to render one tile of it.
+  void setOffset(double ox, double oy) {
+    offset_x_ = ox;
+    offset_y_ = oy;
+  }
+
+  // Switches to a perspective camera with the given field of view (degrees,
+  // for the larger side of the image) looking at the box center from
+  // eye_distance along the viewing axis. With eye_distance <= 0 the eye is
+  // placed where the plane through the box center keeps the current scale.
+  // fov_deg <= 0 switches back to the orthographic projection.
+  void setPerspective(double fov_deg, double eye_distance = 0.0) {
+    fov_ = (fov_deg > 0.0 && fov_deg < 180.0) ? fov_deg : 0.0;
+    eye_ = eye_distance;
+    update_();
+  }
+
+  bool perspective() const {
+    return fov_ > 0.0;
+  }
+
   void rotateX(double a) {
     a = a / 180.0 * M_PI;
     R_ = R_ * rotX(a);
+    update_();
   }
   void rotateY(double a) {
     a = a / 180.0 * M_PI;
     R_ = R_ * rotY(a);
+    update_();
   }
   void rotateZ(double a) {
     a = a / 180.0 * M_PI;
     R_ = R_ * rotZ(a);
+    update_();
   }
 
   [[nodiscard]] Vector3d to_view(const Vector3d &p_world) const {
@@ -99,7 +148,7 @@ public:
   }
 
   [[nodiscard]] std::pair<int, int> canvas_size() const {
-    Bounds2D b = bounds2d_unscaled_();
+    const Bounds2D &b = bounds_;
     double w = (b.max_y - b.min_y) * scale_;
     double h = (b.max_z - b.min_z) * scale_;
     int wi = static_cast<int>(std::ceil(w));
@@ -107,22 +156,68 @@ public:
     return {wi, hi};
   }
 
+  // Orthographic views keep the direct formula, so that their output does
+  // not change with the perspective code; perspective views take one
+  // transform by the precomputed matrix M_ (see update_()). The screen
+  // offset is added after the divide in both.
+  [[nodiscard]] Projected project(const Vector3d &p) const {
+    if (fov_ <= 0.0) {
+      const Vector3d v = to_view(p);
+      const double sx = (v.y - cy_) * scale_ + 0.5 * width_ - offset_x_;
+      const double sy = (v.z - cz_) * scale_ + 0.5 * height_ - offset_y_;
+      return {sx, sy, v.x, scale_};
+    }
+    const auto &m = M_.m;
+    const double X = m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3];
+    const double Y = m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3];
+    const double Z = m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3];
+    const double W = m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3];
+    if (W < near_w_) {
+      return {0.0, 0.0, Z, 0.0};
+    }
+    const double iw = 1.0 / W;
+    return {X * iw + 0.5 * width_ - offset_x_, Y * iw + 0.5 * height_ - offset_y_, Z, scale_ * iw};
+  }
+
+  // Screen position (x, y) and depth (z, larger is nearer) of a point.
+  [[nodiscard]] Vector3d project3d(const Vector3d &p_world) const {
+    const Projected s = project(p_world);
+    return {s.x, s.y, s.depth};
+  }
+
   [[nodiscard]] Vector2d project2d(const Vector3d &p_world) const {
-    Vector3d v = to_view(p_world);
-    Bounds2D b = bounds2d_unscaled_();
-    const double cy = 0.5 * (b.min_y + b.max_y);
-    const double cz = 0.5 * (b.min_z + b.max_z);
-    const double width = (b.max_y - b.min_y) * scale_;
-    const double height = (b.max_z - b.min_z) * scale_;
-    double sx = (v.y - cy) * scale_ + 0.5 * width;
-    double sy = (v.z - cz) * scale_ + 0.5 * height;
-    return {sx, sy};
+    Vector3d s = project3d(p_world);
+    return {s.x, s.y};
   }
 
   [[nodiscard]] Vector3d apply_rotation(const Vector3d &v) const {
     return R_ * v;
   }
 
+  // Component along n of the direction from p toward the viewer. For an
+  // orthographic view it does not depend on p.
+  [[nodiscard]] double toward_viewer(const Vector3d &p, const Vector3d &n) const {
+    const Vector3d rn = R_ * n;
+    if (fov_ <= 0.0) return rn.x;
+    const Vector3d v = to_view(p);
+    return rn.x * (d_eye_ - v.x) - rn.y * v.y - rn.z * v.z;
+  }
+
+  // Clips the segment ab to the part beyond the near plane. Returns false
+  // if nothing is left.
+  bool clip_near(Vector3d &a, Vector3d &b) const {
+    const auto &w = M_.m[3];
+    const double wa = w[0] * a.x + w[1] * a.y + w[2] * a.z + w[3] - near_w_;
+    const double wb = w[0] * b.x + w[1] * b.y + w[2] * b.z + w[3] - near_w_;
+    if (wa < 0.0 && wb < 0.0) return false;
+    if (wa < 0.0) {
+      a = a + (b - a) * (wa / (wa - wb));
+    } else if (wb < 0.0) {
+      b = b + (a - b) * (wb / (wb - wa));
+    }
+    return true;
+  }
+
 private:
   struct Bounds2D {
     double min_y, max_y;
@@ -133,6 +228,70 @@ private:
   Vector3d center_;
   double scale_;
   Mat3d R_;
+  double offset_x_ = 0.0, offset_y_ = 0.0;
+  double fov_ = 0.0;  // Field of view in degrees (0: orthographic)
+  double eye_ = 0.0;  // Distance of the eye from the box center (<= 0: automatic)
+  double d_eye_ = 0.0; // Resolved eye distance
+  double near_w_ = 0.0;
+  Bounds2D bounds_;   // Cached bounds2d_unscaled_()
+  double cy_ = 0.0, cz_ = 0.0;          // Center of bounds_
+  double width_ = 0.0, height_ = 0.0;   // Image size in pixels
+  Mat4d M_;           // World -> (X, Y, depth, W) for perspective views (see project())
+
+  // Near plane at this fraction of the distance from the eye to the center.
+  static constexpr double NEAR_FRACTION = 0.01;
+
+  // Recomputes everything derived from the view parameters. With
+  // v = R (p - center), the perspective projection is
+  //   W = (D_eye - v.x) / D_fit      (1 for orthographic)
+  //   X = scale * (v.y - cy)
+  //   Y = scale * (v.z - cz)
+  // and the screen position is (X / W + width / 2 - offset_x, Y / W +
+  // height / 2 - offset_y), where D_fit is the eye distance at which the
+  // center plane keeps the scale.
+  void update_() {
+    bounds_ = bounds2d_unscaled_();
+    const Bounds2D &b = bounds_;
+    cy_ = 0.5 * (b.min_y + b.max_y);
+    cz_ = 0.5 * (b.min_z + b.max_z);
+    width_ = (b.max_y - b.min_y) * scale_;
+    height_ = (b.max_z - b.min_z) * scale_;
+
+    // Row for W in view coordinates (vx, vy, vz, 1).
+    double w[4] = {0.0, 0.0, 0.0, 1.0};
+    near_w_ = std::numeric_limits<double>::lowest();
+    if (fov_ > 0.0) {
+      const double extent = std::max(std::max(b.max_y - b.min_y, b.max_z - b.min_z), 1e-12);
+      const double d_fit = 0.5 * extent / std::tan(0.5 * fov_ / 180.0 * M_PI);
+      d_eye_ = (eye_ > 0.0) ? eye_ : d_fit;
+      w[0] = -1.0 / d_fit;
+      w[3] = d_eye_ / d_fit;
+      near_w_ = NEAR_FRACTION * d_eye_ / d_fit;
+    }
+    Mat4d A{};
+    for (int j = 0; j < 4; ++j) {
+      A.m[3][j] = w[j];
+    }
+    A.m[0][1] = scale_;
+    A.m[0][3] = -scale_ * cy_;
+    A.m[1][2] = scale_;
+    A.m[1][3] = -scale_ * cz_;
+    A.m[2][0] = 1.0;
+
+    // View transform: v = R p - R center.
+    const Vector3d rc = R_ * center_;
+    Mat4d V{};
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        V.m[i][j] = R_.m[i][j];
+      }
+    }
+    V.m[0][3] = -rc.x;
+    V.m[1][3] = -rc.y;
+    V.m[2][3] = -rc.z;
+    V.m[3][3] = 1.0;
+    M_ = A * V;
+  }
 
   std::array<Vector3d, 8> corners_() const {
     const double xs[2] = {bmin_.x, bmax_.x};
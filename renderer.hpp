@@ -1,48 +1,180 @@
 #pragma once
+#include "bonds.hpp"
 #include "canvas.hpp"
+#include "colormap.hpp"
 #include "condition.hpp"
 #include "projector.hpp"
+#include "shading.hpp"
+#include "tiles.hpp"
 #include "vector3d.hpp"
+#include <array>
 #include <cstdio>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
 #include <lammpstrj/lammpstrj.hpp>
 namespace trj_render {
 
-inline constexpr int MAX_ATOM_TYPES = 16;
+// Shaded sprites of a perspective view are cached up to this pixel radius.
+inline constexpr long SPRITE_CACHE_MAX_RADIUS = 64;
 
 class Renderer {
 public:
+  // Which atoms to draw when static atoms are cached in a background layer.
+  enum class Layer { All,
+                     Static,
+                     Moving };
+
   Renderer(Projector &projector) : projector_(projector) {
     background_ = {0, 0, 0};
     box_line_ = {255, 255, 255};
+  }
 
-    for (int t = 0; t <= MAX_ATOM_TYPES; ++t) {
-      atom_outline_[t] = {0, 0, 0};
-      atom_fill_[t] = {64, 128, 255};
-      atom_radius_[t] = 0.5;
+  // Grows the per-type tables so that types 0 ... type can be used.
+  // They are sized by the largest type actually seen, not by a fixed limit.
+  void ensure_type(int type) {
+    const std::size_t n = static_cast<std::size_t>(type) + 1;
+    if (type < 0 || n <= atom_radius_.size()) return;
+    static const Color palette[] = {
+        {64, 128, 255},
+        {230, 64, 64},  // 赤
+        {64, 200, 64},  // 緑
+        {64, 100, 255}, // 青
+        {255, 210, 64}, // 黄
+    };
+    for (std::size_t t = atom_radius_.size(); t < n; ++t) {
+      atom_outline_.push_back({0, 0, 0});
+      atom_fill_.push_back(t < 5 ? palette[t] : palette[0]);
+      atom_radius_.push_back(0.5);
     }
-    if (MAX_ATOM_TYPES >= 1) atom_fill_[1] = {230, 64, 64};  // 赤
-    if (MAX_ATOM_TYPES >= 2) atom_fill_[2] = {64, 200, 64};  // 緑
-    if (MAX_ATOM_TYPES >= 3) atom_fill_[3] = {64, 100, 255}; // 青
-    if (MAX_ATOM_TYPES >= 4) atom_fill_[4] = {255, 210, 64}; // 黄
+    sprites_.resize(n);
+    static_type_.resize(n, 0);
+  }
+
+  void set_projector(const Projector &projector) {
+    projector_ = projector;
+    static_layer_.reset();
+  }
+
+  const Projector &projector() const {
+    return projector_;
   }
 
-  void set_atom_radius(int type, double radius) {
+  // Frames are written as <prefix>.NNNN.png (default "frame").
+  void set_output_prefix(const std::string &prefix) {
+    output_prefix_ = prefix;
+  }
+
+  // Returns false (and does nothing) for a negative type.
+  bool set_atom_radius(int type, double radius) {
+    if (type < 0) return false;
+    ensure_type(type);
     atom_radius_[type] = radius;
+    return true;
+  }
+
+  // Colors atoms by a per-atom column of the trajectory (see ScalarColumn)
+  // instead of by type. An empty name restores the per-type colors.
+  void set_color_by(const std::string &column) {
+    color_by_ = column;
+  }
+
+  const std::string &color_by() const {
+    return color_by_;
   }
 
-  std::vector<uint8_t> get_visible(Projector &proj) {
+  // Returns false if the colormap name is unknown.
+  bool set_colormap(const std::string &name) {
+    return colormap_.build(name);
+  }
+
+  // Fixes the value range of the colormap. Without it, each frame uses the
+  // minimum and maximum of its own values.
+  void set_color_range(double vmin, double vmax) {
+    fixed_range_ = true;
+    colormap_.set_range(vmin, vmax);
+  }
+
+  // Per-atom values for the next frames, in the order of the atoms passed
+  // to draw_frame (nullptr: color by type).
+  void set_scalar(const double *values, double vmin, double vmax) {
+    scalar_ = values;
+    if (values && !fixed_range_) {
+      colormap_.set_range(vmin, vmax);
+    }
+  }
+
+  // Draws atoms as lit spheres instead of outlined discs.
+  void set_shading(bool shade) {
+    shade_ = shade;
+  }
+
+  // Marks atoms of the given type as static. Static atoms are drawn once,
+  // from the first rendered frame, into a cached background layer, and
+  // every frame only draws the moving atoms on top of it.
+  // Returns false (and does nothing) for a negative type.
+  bool add_static_type(int type) {
+    if (type < 0) return false;
+    ensure_type(type);
+    static_type_[type] = 1;
+    return true;
+  }
+
+  // Marks atoms with id_min <= id <= id_max as static (see add_static_type).
+  void add_static_ids(int id_min, int id_max) {
+    static_ids_.emplace_back(id_min, id_max);
+    std::sort(static_ids_.begin(), static_ids_.end());
+  }
+
+  bool incremental() const {
+    return !static_ids_.empty() || std::find(static_type_.begin(), static_type_.end(), 1) != static_type_.end();
+  }
+
+  bool is_static(const lammpstrj::Atom &a) const {
+    if (a.type >= 0 && static_cast<std::size_t>(a.type) < static_type_.size() && static_type_[a.type]) return true;
+    auto it = std::upper_bound(static_ids_.begin(), static_ids_.end(), std::make_pair(a.id, std::numeric_limits<int>::max()));
+    while (it != static_ids_.begin()) {
+      --it;
+      if (a.id <= it->second) return true;
+    }
+    return false;
+  }
+
+  // Draws bonds between atoms of types t1 and t2 closer than rc.
+  // Returns false (and does nothing) for a negative type.
+  bool set_bond(int t1, int t2, double rc) {
+    if (t1 < 0 || t2 < 0) return false;
+    bond_search_.set_cutoff(t1, t2, rc);
+    return true;
+  }
+
+  // Line width of bonds in output pixels.
+  void set_bond_width(int w) {
+    bond_width_ = std::max(1, w);
+  }
+
+  // Whether bonds are searched across the periodic boundaries of the box.
+  void set_periodic(bool periodic) {
+    bond_search_.set_periodic(periodic);
+  }
+
+  // Renders at n times the resolution and box-filters the result down.
+  void set_antialias(int n) {
+    aa_ = std::clamp(n, 1, 16);
+  }
+
+  // Which edges of the box [lo, hi] belong to a face seen from the front.
+  std::vector<uint8_t> get_visible(Projector &proj, const Vector3d &lo, const Vector3d &hi) {
     std::vector<uint8_t> is_face_front(6, 1);
-    auto v1 = proj.apply_rotation(trj_render::Vector3d(1, 0, 0));
-    is_face_front[0] = (v1.x < 0);
-    is_face_front[3] = !(v1.x < 0);
-    auto v2 = proj.apply_rotation(trj_render::Vector3d(0, 1, 0));
-    is_face_front[1] = (v2.x < 0);
-    is_face_front[4] = !(v2.x < 0);
-    auto v3 = proj.apply_rotation(trj_render::Vector3d(0, 0, 1));
-    is_face_front[2] = (v3.x < 0);
-    is_face_front[5] = !(v3.x < 0);
+    const Vector3d ex(1, 0, 0), ey(0, 1, 0), ez(0, 0, 1);
+    is_face_front[0] = (proj.toward_viewer(lo, ex) < 0);
+    is_face_front[3] = !(proj.toward_viewer(hi, ex) < 0);
+    is_face_front[1] = (proj.toward_viewer(lo, ey) < 0);
+    is_face_front[4] = !(proj.toward_viewer(hi, ey) < 0);
+    is_face_front[2] = (proj.toward_viewer(lo, ez) < 0);
+    is_face_front[5] = !(proj.toward_viewer(hi, ez) < 0);
 
     std::vector<uint8_t> is_edge_visible(12, 1);
 
@@ -63,14 +195,14 @@ public:
   }
 
   void draw_simulation_box_back(Vector3d c[8], int edges[12][2], Canvas &canvas, Projector &proj) {
-    auto visible = get_visible(proj);
+    auto visible = get_visible(proj, c[0], c[7]);
     canvas.set_color(box_line_);
     for (int i = 0; i < 12; i++) {
       if (visible[i]) continue;
-      Vector2d p1 = proj.project2d(c[edges[i][0]]);
-      Vector2d p2 = proj.project2d(c[edges[i][1]]);
-      canvas.moveto(p1);
-      canvas.lineto(p2);
+      Vector3d a = c[edges[i][0]], b = c[edges[i][1]];
+      if (!proj.clip_near(a, b)) continue;
+      canvas.moveto(proj.project2d(a));
+      canvas.lineto(proj.project2d(b));
     }
   }
 
@@ -87,14 +219,14 @@ public:
     };
     int edges[12][2] = {
         {0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
-    auto visible = get_visible(proj);
+    auto visible = get_visible(proj, c[0], c[7]);
     canvas.set_color(box_line_);
     for (int i = 0; i < 12; i++) {
       if (visible[i] ^ draw_back) continue;
-      Vector2d p1 = proj.project2d(c[edges[i][0]]);
-      Vector2d p2 = proj.project2d(c[edges[i][1]]);
-      canvas.moveto(p1);
-      canvas.lineto(p2);
+      Vector3d a = c[edges[i][0]], b = c[edges[i][1]];
+      if (!proj.clip_near(a, b)) continue;
+      canvas.moveto(proj.project2d(a));
+      canvas.lineto(proj.project2d(b));
     }
   }
 
@@ -115,47 +247,346 @@ public:
     return true;
   }
 
-  void draw_atoms(std::vector<lammpstrj::Atom> &atoms, Canvas &canvas, Projector &proj) {
-    std::vector<Vector3d> pos;
-    for (auto a : atoms) {
-      pos.push_back(Vector3d(a.x, a.y, a.z));
-    }
-    std::vector<std::size_t> idx(atoms.size());
+  // An atom which passed the conditions and the culling, in screen
+  // coordinates; scale is the number of pixels per length unit at its depth.
+  // A bond item is the half of a bond owned by atom `index`: a line from
+  // (x - dx, y - dy) to (x + dx, y + dy) of half length about r.
+  struct ScreenAtom {
+    double x, y, r, depth, scale;
+    int type;
+    std::size_t index;
+    double dx = 0.0, dy = 0.0;
+    bool bond = false;
+  };
+
+  // Applies the conditions, projects the atoms, drops those which do not
+  // touch the width x height canvas, and sorts the rest back to front.
+  // When the conditions restrict the region, atoms outside their bounding
+  // box are rejected with plain comparisons before the conditions run.
+  // A cell grid was measured to be slower here, since building it is itself
+  // a pass over all atoms (tests/bench_cull.cpp).
+  std::vector<ScreenAtom> visible_atoms(std::vector<lammpstrj::Atom> &atoms, int width, int height, Projector &proj,
+                                       Layer layer = Layer::All) {
+    std::vector<ScreenAtom> items;
+    if (atoms.empty()) return items;
+    std::vector<Vector3d> pos(atoms.size());
+    Vector3d lo(1e300, 1e300, 1e300), hi(-1e300, -1e300, -1e300);
+    int max_type = 0;
     for (std::size_t i = 0; i < atoms.size(); ++i) {
-      idx[i] = i;
+      const auto &a = atoms[i];
+      pos[i] = Vector3d(a.x, a.y, a.z);
+      lo = Vector3d(std::min(lo.x, a.x), std::min(lo.y, a.y), std::min(lo.z, a.z));
+      hi = Vector3d(std::max(hi.x, a.x), std::max(hi.y, a.y), std::max(hi.z, a.z));
+      max_type = std::max(max_type, a.type);
+    }
+    ensure_type(max_type);
+    Vector3d clip_lo = lo, clip_hi = hi;
+    for (auto &cond : conditions_) {
+      cond->clip(clip_lo, clip_hi);
+    }
+    if (clip_lo.x > clip_hi.x || clip_lo.y > clip_hi.y || clip_lo.z > clip_hi.z) return items;
+
+    auto consider = [&](std::size_t i) {
+      if (layer != Layer::All && is_static(atoms[i]) != (layer == Layer::Static)) return;
+      const int t = atoms[i].type;
+      if (t < 0) return;
+      if (!check_all(atoms[i])) return;
+      const Projected s = proj.project(pos[i]);
+      if (s.scale <= 0.0) return; // Behind the near plane
+      const double r = atom_radius_[t] * s.scale;
+      if (s.x + r < 0 || s.x - r >= width || s.y + r < 0 || s.y - r >= height) return;
+      items.push_back({s.x, s.y, r, s.depth, s.scale, t, i});
+    };
+
+    const bool clipped = clip_lo.x > lo.x || clip_lo.y > lo.y || clip_lo.z > lo.z ||
+                         clip_hi.x < hi.x || clip_hi.y < hi.y || clip_hi.z < hi.z;
+    if (clipped) {
+      for (std::size_t i = 0; i < atoms.size(); ++i) {
+        const Vector3d &p = pos[i];
+        if (p.x < clip_lo.x || p.x > clip_hi.x || p.y < clip_lo.y || p.y > clip_hi.y ||
+            p.z < clip_lo.z || p.z > clip_hi.z) continue;
+        consider(i);
+      }
+    } else {
+      for (std::size_t i = 0; i < atoms.size(); ++i) {
+        consider(i);
+      }
+    }
+    if (layer != Layer::Static && bond_search_.enabled()) {
+      add_bonds(atoms, pos, width, height, proj, items);
     }
-    std::sort(idx.begin(), idx.end(),
-              [&](std::size_t ia, std::size_t ib) {
-                double da = proj.depth(pos[ia]);
-                double db = proj.depth(pos[ib]);
-                return da < db;
+    std::sort(items.begin(), items.end(),
+              [](const ScreenAtom &a, const ScreenAtom &b) {
+                return a.depth < b.depth;
               });
-    for (std::size_t i : idx) {
-      if (!check_all(atoms[i])) continue;
-      const auto t = atoms[i].type;
-      const double r = atom_radius_[t] * proj.scale();
-      Vector2d s = proj.project2d(pos[i]);
-      canvas.set_color(atom_fill_[t]);
-      canvas.fill_circle(s.x, s.y, r);
+    return items;
+  }
+
+  // Adds two items per bond between atoms which pass the conditions: each
+  // atom's half, from its surface to the middle of the bond, so that bonds
+  // take the colors of their atoms and are depth-sorted with them.
+  void add_bonds(std::vector<lammpstrj::Atom> &atoms, const std::vector<Vector3d> &pos, int width, int height,
+                 const Projector &proj, std::vector<ScreenAtom> &items) {
+    bond_type_.resize(atoms.size());
+    bond_use_.resize(atoms.size());
+    for (std::size_t i = 0; i < atoms.size(); ++i) {
+      bond_type_[i] = atoms[i].type;
+      bond_use_[i] = atoms[i].type >= 0 && check_all(atoms[i]);
+    }
+    const double pen = 0.5 * bond_width_ * aa_;
+    auto half = [&](std::size_t i, const Vector3d &d) {
+      const int t = atoms[i].type;
+      const double len = d.norm();
+      const double r = atom_radius_[t];
+      if (2.0 * r >= len) return; // Hidden inside the atom
+      Vector3d a = pos[i] + d * (r / len), b = pos[i] + d * 0.5;
+      if (!proj.clip_near(a, b)) return;
+      const Projected sa = proj.project(a), sb = proj.project(b);
+      const double x = 0.5 * (sa.x + sb.x), y = 0.5 * (sa.y + sb.y);
+      const double dx = 0.5 * (sb.x - sa.x), dy = 0.5 * (sb.y - sa.y);
+      const double extent = std::hypot(dx, dy) + pen;
+      if (x + extent < 0 || x - extent >= width || y + extent < 0 || y - extent >= height) return;
+      items.push_back({x, y, extent, 0.5 * (sa.depth + sb.depth), 0.5 * (sa.scale + sb.scale), t, i, dx, dy, true});
+    };
+    for (const Bond &b : bond_search_.find(pos, bond_type_, bond_use_, box_lo_, box_hi_)) {
+      half(b.i, b.d);
+      half(b.j, b.d * -1.0);
+    }
+  }
+
+  void draw_atoms(std::vector<lammpstrj::Atom> &atoms, Canvas &canvas, Projector &proj, Layer layer = Layer::All) {
+    const auto items = visible_atoms(atoms, canvas.get_width(), canvas.get_height(), proj, layer);
+    for (const auto &item : items) {
+      draw_atom(item, canvas, proj);
+    }
+  }
+
+  void draw_atom(const ScreenAtom &item, Canvas &canvas, const Projector &proj) {
+    const int t = item.type;
+    const double r = item.r;
+    const Vector2d s{item.x, item.y};
+    const Color fill = scalar_ ? colormap_(scalar_[item.index]) : atom_fill_[t];
+    canvas.set_depth(item.depth);
+    if (item.bond) {
+      canvas.set_color(fill);
+      canvas.set_line_width(bond_width_ * aa_);
+      canvas.moveto(Vector2d{item.x - item.dx, item.y - item.dy});
+      canvas.lineto(Vector2d{item.x + item.dx, item.y + item.dy});
+      canvas.set_line_width(1);
+      return;
+    }
+    if (shade_ && proj.perspective()) {
+      const int ix = static_cast<int>(std::floor(s.x));
+      const int iy = static_cast<int>(std::floor(s.y));
+      sized_sprite(r).draw(canvas, fill, ix, iy, item.depth, 1.0 / item.scale);
+      return;
+    }
+    if (shade_) {
+      SphereSprite &sprite = sprites_[t];
+      if (!sprite.matches(r, atom_fill_[t])) {
+        sprite.build(r, atom_fill_[t]);
+      }
+      const int ix = static_cast<int>(std::floor(s.x));
+      const int iy = static_cast<int>(std::floor(s.y));
+      if (scalar_) {
+        sprite.draw(canvas, fill, ix, iy, item.depth, 1.0 / proj.scale());
+      } else {
+        sprite.draw(canvas, ix, iy, item.depth, 1.0 / proj.scale());
+      }
+      return;
+    }
+    if (aa_ > 1) {
+      // Supersampled: keep subpixel centers and draw the outline as a
+      // ring which is aa_ pixels wide, i.e. one pixel after downsampling.
       canvas.set_color(atom_outline_[t]);
-      canvas.draw_circle(s.x, s.y, r);
+      canvas.fill_circle(s.x, s.y, r);
+      canvas.set_color(fill);
+      canvas.fill_circle(s.x, s.y, r - aa_);
+      return;
     }
+    const int ix = canvas.pixel_x(s.x);
+    const int iy = canvas.pixel_y(s.y);
+    const int ir = static_cast<int>(r);
+    canvas.set_color(fill);
+    canvas.fill_circle(ix, iy, ir);
+    canvas.set_color(atom_outline_[t]);
+    canvas.draw_circle(ix, iy, ir);
   }
 
-  void draw_frame(const std::unique_ptr<lammpstrj::SystemInfo> &si,
-                  std::vector<lammpstrj::Atom> &atoms) {
+  // Sprite of pixel radius r for a perspective view, where the radius
+  // changes with depth. Radii are rounded to whole pixels and the sprites
+  // are drawn tinted, so one cache of at most SPRITE_CACHE_MAX_RADIUS
+  // sprites serves all types and colors. Larger atoms, very close to the
+  // eye, share one sprite which is rebuilt when their radius changes.
+  const SphereSprite &sized_sprite(double r) {
+    const Color white{255, 255, 255};
+    const long radius = std::max(1L, std::lround(r));
+    SphereSprite &sprite = (radius > SPRITE_CACHE_MAX_RADIUS) ? huge_sprite_ : sized_sprites_[radius - 1];
+    if (!sprite.matches(static_cast<double>(radius), white)) {
+      sprite.build(static_cast<double>(radius), white);
+    }
+    return sprite;
+  }
+
+  // Box of the current frame, across which periodic bonds are searched.
+  void set_box(const std::unique_ptr<lammpstrj::SystemInfo> &si) {
+    box_lo_ = Vector3d(si->x_min, si->y_min, si->z_min);
+    box_hi_ = Vector3d(si->x_max, si->y_max, si->z_max);
+  }
+
+  // Projector for the (supersampled) canvas which is actually drawn on.
+  Projector render_projector() const {
+    Projector proj = projector_;
+    if (aa_ > 1) {
+      proj.setScale(projector_.scale() * aa_);
+    }
+    return proj;
+  }
+
+  Canvas render_frame(const std::unique_ptr<lammpstrj::SystemInfo> &si,
+                      std::vector<lammpstrj::Atom> &atoms) {
+    set_box(si);
     auto [width, height] = projector_.canvas_size();
+    Projector proj = render_projector();
+    const int w = width * aa_;
+    const int h = height * aa_;
+    Canvas canvas = incremental() ? static_layer(si, atoms, proj, w, h) : blank_canvas(si, proj, w, h);
+    draw_atoms(atoms, canvas, proj, incremental() ? Layer::Moving : Layer::All);
+    canvas.set_depth_test(false);
+    draw_simulation_box_front(si, canvas, proj);
+    if (aa_ == 1) {
+      return canvas;
+    }
+    return canvas.downsample(aa_);
+  }
+
+  // Background and the back edges of the simulation box. Shaded spheres
+  // are always depth-tested at their surface, so that a frame looks the
+  // same whether or not part of it comes from the static layer.
+  Canvas blank_canvas(const std::unique_ptr<lammpstrj::SystemInfo> &si, Projector &proj, int width, int height,
+                      int origin_x = 0, int origin_y = 0) {
     Canvas canvas(width, height);
+    canvas.set_origin(origin_x, origin_y);
+    canvas.set_line_width(aa_);
     canvas.set_color(background_);
     canvas.fill_rect(0, 0, width, height);
-    draw_simulation_box_back(si, canvas, projector_);
-    draw_atoms(atoms, canvas, projector_);
-    draw_simulation_box_front(si, canvas, projector_);
+    draw_simulation_box_back(si, canvas, proj);
+    if (shade_) canvas.enable_depth();
+    return canvas;
+  }
+
+  // Cached blank canvas with the static atoms drawn into it, with depth.
+  // It is built from the first frame it is requested for, and rebuilt when
+  // the size or the box changes, since it holds the back edges of the box.
+  const Canvas &static_layer(const std::unique_ptr<lammpstrj::SystemInfo> &si,
+                             std::vector<lammpstrj::Atom> &atoms, Projector &proj, int width, int height) {
+    const std::array<double, 6> box = {si->x_min, si->x_max, si->y_min, si->y_max, si->z_min, si->z_max};
+    if (!static_layer_ || static_layer_->get_width() != width || static_layer_->get_height() != height ||
+        box != static_box_) {
+      static_box_ = box;
+      static_layer_ = std::make_unique<Canvas>(blank_canvas(si, proj, width, height));
+      static_layer_->enable_depth();
+      draw_atoms(atoms, *static_layer_, proj, Layer::Static);
+    }
+    return *static_layer_;
+  }
+
+  // Renders the frame tile by tile into a DeepZoom pyramid `name`.dzi.
+  // Atoms are projected and depth-sorted once, then binned per tile, so
+  // memory is bounded by one tile plus the per-atom arrays.
+  // Static atoms (add_static_type) are drawn with the others in this mode.
+  // Returns false if any file could not be written.
+  bool draw_frame_tiled(const std::unique_ptr<lammpstrj::SystemInfo> &si,
+                        std::vector<lammpstrj::Atom> &atoms, const std::string &name) {
+    set_box(si);
+    auto [width, height] = projector_.canvas_size();
+    Projector proj = render_projector();
+    DeepZoomWriter dz(name, width, height, tile_size_);
+    const int cols = dz.columns(), rows = dz.rows();
+    const double ts = static_cast<double>(tile_size_) * aa_;
+    const auto items = visible_atoms(atoms, width * aa_, height * aa_, proj);
+
+    // Bin atoms into the tiles their discs touch (counting sort, so that
+    // every bin keeps the back to front order).
+    auto tile_span = [&](const ScreenAtom &a, int &c1, int &c2, int &r1, int &r2) {
+      c1 = std::clamp(static_cast<int>(std::floor((a.x - a.r - 1) / ts)), 0, cols - 1);
+      c2 = std::clamp(static_cast<int>(std::floor((a.x + a.r + 1) / ts)), 0, cols - 1);
+      r1 = std::clamp(static_cast<int>(std::floor((a.y - a.r - 1) / ts)), 0, rows - 1);
+      r2 = std::clamp(static_cast<int>(std::floor((a.y + a.r + 1) / ts)), 0, rows - 1);
+    };
+    std::vector<std::size_t> begin(static_cast<std::size_t>(cols) * rows + 1, 0);
+    int c1, c2, r1, r2;
+    for (const auto &a : items) {
+      tile_span(a, c1, c2, r1, r2);
+      for (int r = r1; r <= r2; r++)
+        for (int c = c1; c <= c2; c++)
+          begin[r * cols + c + 1]++;
+    }
+    for (std::size_t k = 1; k < begin.size(); k++) {
+      begin[k] += begin[k - 1];
+    }
+    std::vector<uint32_t> bins(begin.back());
+    std::vector<std::size_t> fill(begin.begin(), begin.end() - 1);
+    for (std::size_t i = 0; i < items.size(); i++) {
+      tile_span(items[i], c1, c2, r1, r2);
+      for (int r = r1; r <= r2; r++)
+        for (int c = c1; c <= c2; c++)
+          bins[fill[r * cols + c]++] = static_cast<uint32_t>(i);
+    }
+
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        auto [tw, th] = dz.tile_extent(col, row);
+        const int ox = col * tile_size_ * aa_, oy = row * tile_size_ * aa_;
+        Projector tp = proj;
+        tp.setOffset(ox, oy);
+        Canvas canvas = blank_canvas(si, tp, tw * aa_, th * aa_, ox, oy);
+        const std::size_t k1 = begin[row * cols + col], k2 = begin[row * cols + col + 1];
+        for (std::size_t k = k1; k < k2; k++) {
+          ScreenAtom a = items[bins[k]];
+          a.x -= ox;
+          a.y -= oy;
+          draw_atom(a, canvas, tp);
+        }
+        canvas.set_depth_test(false);
+        draw_simulation_box_front(si, canvas, tp);
+        Canvas out = (aa_ > 1) ? canvas.downsample(aa_) : std::move(canvas);
+        if (!dz.write_tile(col, row, out)) return false;
+      }
+    }
+    return dz.finish();
+  }
+
+  // Writes frames as DeepZoom tile pyramids with tiles of n x n pixels
+  // instead of single PNG files (0 = off).
+  void set_tile_size(int n) {
+    tile_size_ = std::max(0, n);
+  }
+
+  // Renders the frame to its output file(s). Returns false (after printing
+  // an error) if they could not be written.
+  bool draw_frame(const std::unique_ptr<lammpstrj::SystemInfo> &si,
+                  std::vector<lammpstrj::Atom> &atoms) {
     std::ostringstream oss;
-    oss << "frame." << std::setw(4) << std::setfill('0') << si->frame_index << ".png";
+    oss << output_prefix_ << "." << std::setw(4) << std::setfill('0') << si->frame_index;
+    if (tile_size_ > 0) {
+      std::cout << oss.str() << ".dzi" << std::endl;
+      return draw_frame_tiled(si, atoms, oss.str());
+    }
+    Canvas canvas = render_frame(si, atoms);
+    oss << ".png";
     std::string filename = oss.str();
     std::cout << filename << std::endl;
-    canvas.save(filename.c_str());
+    // A frame identical to the previous one reuses its encoded PNG.
+    if (last_png_.empty() || canvas.image_buffer != last_image_) {
+      last_png_ = canvas.encode();
+      last_image_ = std::move(canvas.image_buffer);
+    }
+    if (lodepng::save_file(last_png_, filename) != 0) {
+      std::cerr << "Error: could not write " << filename << std::endl;
+      return false;
+    }
+    return true;
   }
   void add_condition(std::unique_ptr<Condition> cond) {
     conditions_.push_back(std::move(cond));
@@ -165,9 +596,32 @@ private:
   Projector projector_;
   Color background_;
   Color box_line_;
+  int aa_ = 1;
+  int tile_size_ = 0;
+  std::string output_prefix_ = "frame";
+  std::string color_by_;
+  ColorMap colormap_;
+  bool fixed_range_ = false;
+  const double *scalar_ = nullptr;
+  bool shade_ = false;
   std::vector<std::unique_ptr<Condition>> conditions_;
-  std::array<Color, MAX_ATOM_TYPES + 1> atom_outline_;
-  std::array<Color, MAX_ATOM_TYPES + 1> atom_fill_;
-  std::array<double, MAX_ATOM_TYPES + 1> atom_radius_;
+  std::vector<Color> atom_outline_;
+  std::vector<Color> atom_fill_;
+  std::vector<double> atom_radius_;
+  std::vector<SphereSprite> sprites_;
+  // Perspective sprites, indexed by pixel radius - 1 (see sized_sprite)
+  std::vector<SphereSprite> sized_sprites_ = std::vector<SphereSprite>(SPRITE_CACHE_MAX_RADIUS);
+  SphereSprite huge_sprite_;
+  BondSearch bond_search_;
+  int bond_width_ = 1;
+  Vector3d box_lo_, box_hi_;
+  std::vector<int> bond_type_;
+  std::vector<char> bond_use_;
+  std::vector<char> static_type_;
+  std::vector<std::pair<int, int>> static_ids_;
+  std::unique_ptr<Canvas> static_layer_;
+  std::array<double, 6> static_box_{}; // Box the static layer was drawn for
+  std::vector<unsigned char> last_image_;
+  std::vector<unsigned char> last_png_;
 };
 } // namespace trj_render
\ No newline at end of file
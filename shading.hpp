@@ -0,0 +1,137 @@
+#pragma once
+#include "canvas.hpp"
+#include "vector3d.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace trj_render {
+
+// Precomputed image of a lit sphere of a given pixel radius and base color.
+// All atoms of a type share one sprite, so drawing a shaded atom costs a
+// masked copy per pixel, the same order as a flat fill.
+class SphereSprite {
+public:
+  // Light direction in screen coordinates (x right, y down, z toward the viewer).
+  static constexpr double LX = -0.45, LY = -0.55, LZ = 0.70;
+  static constexpr double AMBIENT = 0.25;
+  static constexpr double SPECULAR = 0.35;
+
+  bool matches(double radius, Color c) const {
+    return radius == radius_ && c.r == color_.r && c.g == color_.g && c.b == color_.b;
+  }
+
+  void build(double radius, Color c) {
+    radius_ = radius;
+    color_ = c;
+    half_ = std::max(0, static_cast<int>(std::ceil(radius)));
+    const int size = 2 * half_ + 1;
+    span_begin_.assign(size, size);
+    span_end_.assign(size, 0);
+    rgb_.assign(size * size * 3, 0);
+    height_.assign(size * size, 0.0f);
+    diffuse_.assign(size * size, 0);
+    specular_.assign(size * size, 0);
+    if (radius <= 0.0) return;
+
+    const Vector3d l = Vector3d(LX, LY, LZ).normalized();
+    const Vector3d h = (l + Vector3d(0, 0, 1)).normalized();
+    const double r2 = radius * radius;
+    for (int j = 0; j < size; j++) {
+      const double dy = j - half_;
+      for (int i = 0; i < size; i++) {
+        const double dx = i - half_;
+        const double d2 = dx * dx + dy * dy;
+        if (d2 > r2) continue;
+        span_begin_[j] = std::min(span_begin_[j], i);
+        span_end_[j] = std::max(span_end_[j], i);
+        const Vector3d n(dx / radius, dy / radius, std::sqrt(std::max(0.0, 1.0 - d2 / r2)));
+        const double diffuse = std::max(0.0, n.dot(l));
+        const double spec = SPECULAR * std::pow(std::max(0.0, n.dot(h)), 32);
+        // Darken toward the silhouette, which mimics the occlusion seen
+        // where spheres touch and separates overlapping atoms.
+        const double ao = 0.55 + 0.45 * n.z;
+        const double k = ao * (AMBIENT + (1.0 - AMBIENT) * diffuse);
+        height_[j * size + i] = static_cast<float>(radius * n.z);
+        diffuse_[j * size + i] = static_cast<uint16_t>(std::lround(k * 256.0));
+        specular_[j * size + i] = static_cast<unsigned char>(std::min(255.0, 255.0 * spec + 0.5));
+        unsigned char *p = &rgb_[(j * size + i) * 3];
+        p[0] = shade(c.r, k, spec);
+        p[1] = shade(c.g, k, spec);
+        p[2] = shade(c.b, k, spec);
+      }
+    }
+  }
+
+  // Draws the sprite so that its center coincides with pixel (x0, y0).
+  // If the canvas has the depth test on, each pixel is tested at the depth
+  // of the sphere surface, depth + (height in pixels) * depth_per_pixel.
+  void draw(Canvas &canvas, int x0, int y0, double depth = 0.0, double depth_per_pixel = 0.0) const {
+    blit(canvas, x0, y0, depth, depth_per_pixel, [this](unsigned char *dst, int k) {
+      const unsigned char *src = &rgb_[k * 3];
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+    });
+  }
+
+  // Same as above, but shades color c instead of the color the sprite was
+  // built for, using the stored intensity tables (e.g. for colormapped atoms).
+  void draw(Canvas &canvas, Color c, int x0, int y0, double depth = 0.0, double depth_per_pixel = 0.0) const {
+    blit(canvas, x0, y0, depth, depth_per_pixel, [this, c](unsigned char *dst, int k) {
+      const unsigned int kd = diffuse_[k], ks = specular_[k];
+      dst[0] = static_cast<unsigned char>(std::min(255u, ((c.r * kd) >> 8) + ks));
+      dst[1] = static_cast<unsigned char>(std::min(255u, ((c.g * kd) >> 8) + ks));
+      dst[2] = static_cast<unsigned char>(std::min(255u, ((c.b * kd) >> 8) + ks));
+    });
+  }
+
+private:
+  double radius_ = -1.0;
+  Color color_{0, 0, 0};
+  int half_ = 0;
+  std::vector<int> span_begin_, span_end_;
+  std::vector<unsigned char> rgb_;
+  std::vector<uint16_t> diffuse_;       // Intensity factor k in 1/256 units
+  std::vector<unsigned char> specular_; // Specular highlight added to each channel
+  std::vector<float> height_; // Height of the surface above the center plane in pixels
+
+  // Calls pixel(dst, k) for every pixel of the sprite inside the canvas which
+  // passes the depth test; k is the index into the sprite tables.
+  template <class Pixel>
+  void blit(Canvas &canvas, int x0, int y0, double depth, double depth_per_pixel, Pixel pixel) const {
+    const int w = canvas.get_width();
+    const int h = canvas.get_height();
+    const int size = 2 * half_ + 1;
+    const int line = w * 4;
+    for (int j = 0; j < size; j++) {
+      const int y = y0 - half_ + j;
+      if (y < 0 || y >= h) continue;
+      const int i1 = std::max(span_begin_[j], half_ - x0);
+      const int i2 = std::min(span_end_[j], w - 1 - x0 + half_);
+      if (i1 > i2) continue;
+      unsigned char *dst = canvas.image_buffer.data() + y * line + (x0 - half_ + i1) * 4;
+      if (canvas.depth_test_enabled()) {
+        float *z = canvas.depth_buffer.data() + y * w + (x0 - half_ + i1);
+        for (int i = i1; i <= i2; i++, dst += 4, z++) {
+          const float d = static_cast<float>(depth + height_[j * size + i] * depth_per_pixel);
+          if (d < *z) continue;
+          *z = d;
+          pixel(dst, j * size + i);
+        }
+        continue;
+      }
+      for (int i = i1; i <= i2; i++, dst += 4) {
+        pixel(dst, j * size + i);
+      }
+    }
+  }
+
+  static unsigned char shade(unsigned char c, double k, double spec) {
+    const double v = c * k + 255.0 * spec;
+    return static_cast<unsigned char>(std::min(255.0, v + 0.5));
+  }
+};
+
+} // namespace trj_render
@@ -0,0 +1,86 @@
+// Times Renderer::visible_atoms (conditions, projection, culling, depth
+// sort) on random atoms in a 100^3 box, for the whole box and a slab crop,
+// against building a CellGrid over the atoms and selecting the slab cells.
+#include "renderer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace trj_render;
+
+template <class F>
+double best_ms(F f, int repeat = 5) {
+  double best = 1e300;
+  for (int k = 0; k < repeat; k++) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+// Appends the points of all cells of the grid which overlap [lo, hi], the
+// cell-grid alternative to the linear prefilter of visible_atoms.
+void select(const CellGrid &grid, const Vector3d &lo, const Vector3d &hi, std::vector<std::size_t> &out) {
+  const int x1 = grid.cell_coord(lo.x, 0), x2 = grid.cell_coord(hi.x, 0);
+  const int y1 = grid.cell_coord(lo.y, 1), y2 = grid.cell_coord(hi.y, 1);
+  const int z1 = grid.cell_coord(lo.z, 2), z2 = grid.cell_coord(hi.z, 2);
+  const auto &idx = grid.indices();
+  for (int iz = z1; iz <= z2; iz++) {
+    for (int iy = y1; iy <= y2; iy++) {
+      for (int ix = x1; ix <= x2; ix++) {
+        const std::size_t c = grid.index(ix, iy, iz);
+        out.insert(out.end(), idx.begin() + grid.cell_begin(c), idx.begin() + grid.cell_begin(c + 1));
+      }
+    }
+  }
+}
+
+void bench(std::size_t n, bool planar) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> u(0.0, 100.0);
+  std::vector<lammpstrj::Atom> atoms(n);
+  std::vector<Vector3d> pos(n);
+  for (std::size_t i = 0; i < n; i++) {
+    atoms[i] = lammpstrj::Atom{};
+    atoms[i].id = static_cast<int>(i) + 1;
+    atoms[i].type = 1 + static_cast<int>(i % 3);
+    atoms[i].x = u(rng);
+    atoms[i].y = u(rng);
+    atoms[i].z = planar ? 0.0 : u(rng);
+    pos[i] = Vector3d(atoms[i].x, atoms[i].y, atoms[i].z);
+  }
+  Projector proj(Vector3d(0, 0, 0), Vector3d(100, 100, planar ? 0 : 100));
+  proj.rotateY(30);
+  proj.setScale(-1);
+  const auto [w, h] = proj.canvas_size();
+
+  Renderer full(proj);
+  const double t_full = best_ms([&] { full.visible_atoms(atoms, w, h, proj); });
+
+  Renderer slab(proj);
+  slab.add_condition(std::make_unique<XMinCondition>(40.0));
+  slab.add_condition(std::make_unique<XMaxCondition>(42.0));
+  std::size_t visible = 0;
+  const double t_slab = best_ms([&] { visible = slab.visible_atoms(atoms, w, h, proj).size(); });
+
+  CellGrid grid;
+  std::vector<std::size_t> selected;
+  const Vector3d lo(0, 0, 0), hi(100, 100, planar ? 0 : 100);
+  const double t_grid = best_ms([&] {
+    grid.build(pos, lo, hi, CellGrid::cell_size_for(lo, hi, n));
+    selected.clear();
+    select(grid, Vector3d(40, 0, 0), Vector3d(42, 100, 100), selected);
+  });
+
+  std::printf("%9zu atoms%s: full %8.2f ms, slab %8.2f ms (%zu visible), grid build+select alone %8.2f ms\n",
+              n, planar ? " (planar)" : "", t_full, t_slab, visible, t_grid);
+}
+
+int main(int argc, char **argv) {
+  const std::size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  bench(n, false);
+  bench(n * 10, false);
+  bench(n * 10, true);
+}
@@ -0,0 +1,104 @@
+// BondSearch: the cell-list search finds exactly the bonds of an O(N^2)
+// search, each once, with and without periodic boundaries.
+#include "bonds.hpp"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <utility>
+
+using namespace trj_render;
+
+struct Case {
+  const char *name;
+  std::size_t n;
+  double lx, ly, lz; // Box size
+  bool periodic;
+  bool planar;       // All atoms at z = 0
+};
+
+static double cutoff(int a, int b) {
+  if (a == 1 && b == 1) return 1.3;
+  if (a != b) return 1.1;
+  return 0.0; // No 2-2 bonds
+}
+
+// Atoms are at most a little outside the box, so one shift is enough.
+static double minimum_image(double d, double len) {
+  if (!(len > 0.0)) return d;
+  return d - len * ((d > 0.5 * len) - (d < -0.5 * len));
+}
+
+static int run(const Case &c) {
+  std::mt19937 rng(static_cast<unsigned>(c.n));
+  // A margin outside the box, so that periodic wrapping is exercised.
+  std::uniform_real_distribution<double> ux(-0.3, c.lx + 0.3), uy(-0.3, c.ly + 0.3), uz(-0.3, c.lz + 0.3);
+  std::vector<Vector3d> pos(c.n);
+  std::vector<int> type(c.n);
+  std::vector<char> use(c.n, 1);
+  for (std::size_t i = 0; i < c.n; i++) {
+    pos[i] = Vector3d(ux(rng), uy(rng), c.planar ? 0.0 : uz(rng));
+    type[i] = 1 + static_cast<int>(rng() % 2);
+    if (rng() % 10 == 0) use[i] = 0;
+  }
+  const Vector3d lo(0, 0, 0), hi(c.lx, c.ly, c.planar ? 0.0 : c.lz);
+
+  BondSearch search;
+  search.set_cutoff(1, 1, 1.3);
+  search.set_cutoff(1, 2, 1.1);
+  search.set_periodic(c.periodic);
+  const auto &bonds = search.find(pos, type, use, lo, hi);
+
+  int errors = 0;
+  std::set<std::pair<uint32_t, uint32_t>> found;
+  for (const Bond &b : bonds) {
+    const auto key = std::make_pair(std::min(b.i, b.j), std::max(b.i, b.j));
+    if (!found.insert(key).second) errors++; // Reported twice
+    Vector3d d = pos[b.j] - pos[b.i];
+    if (c.periodic) {
+      d = Vector3d(minimum_image(d.x, hi.x - lo.x), minimum_image(d.y, hi.y - lo.y), minimum_image(d.z, hi.z - lo.z));
+    }
+    if ((d - b.d).norm() > 1e-9) errors++; // Wrong bond vector
+  }
+  std::size_t expected = 0;
+  for (std::size_t i = 0; i < c.n; i++) {
+    if (!use[i]) continue;
+    for (std::size_t j = i + 1; j < c.n; j++) {
+      const double rc = cutoff(type[i], type[j]);
+      if (!use[j] || rc <= 0.0) continue;
+      double dx = pos[j].x - pos[i].x, dy = pos[j].y - pos[i].y, dz = pos[j].z - pos[i].z;
+      if (c.periodic) {
+        dx = minimum_image(dx, hi.x - lo.x);
+        dy = minimum_image(dy, hi.y - lo.y);
+        dz = minimum_image(dz, hi.z - lo.z);
+      }
+      if (dx * dx + dy * dy + dz * dz < rc * rc) {
+        expected++;
+        if (!found.count({static_cast<uint32_t>(i), static_cast<uint32_t>(j)})) errors++; // Missing
+      }
+    }
+  }
+  if (found.size() != expected) errors++;
+  if (errors > 0) {
+    std::printf("FAIL %s: %zu bonds, %zu expected, %d errors\n", c.name, bonds.size(), expected, errors);
+  }
+  return errors > 0 ? 1 : 0;
+}
+
+int main() {
+  const Case cases[] = {
+      {"periodic", 3000, 15.0, 15.0, 15.0, true, false},
+      {"open", 3000, 15.0, 15.0, 15.0, false, false},
+      {"periodic, two cells per axis", 500, 2.8, 2.8, 2.8, true, false},
+      {"periodic, planar", 2000, 40.0, 40.0, 0.0, true, true},
+      {"open, planar", 2000, 40.0, 40.0, 0.0, false, true},
+      {"periodic, threaded", BOND_THREAD_MIN_ATOMS, 27.0, 27.0, 27.0, true, false},
+      {"open, threaded", BOND_THREAD_MIN_ATOMS, 27.0, 27.0, 27.0, false, false},
+  };
+  int failures = 0;
+  for (const Case &c : cases) {
+    failures += run(c);
+  }
+  if (failures == 0) std::printf("test_bonds: OK\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+// ColorMap lookup: values outside the range, infinite and NaN values map to
+// the end colors.
+#include "colormap.hpp"
+#include <cstdio>
+#include <limits>
+
+using namespace trj_render;
+
+static bool same(Color a, Color b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+int main() {
+  int failures = 0;
+  auto check = [&failures](bool ok, const char *what) {
+    if (!ok) {
+      std::printf("FAIL %s\n", what);
+      failures++;
+    }
+  };
+  const double inf = std::numeric_limits<double>::infinity();
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  ColorMap m;
+  m.set_range(0.0, 1.0);
+  const Color first = m(0.0), last = m(1.0);
+  check(!same(first, last), "end colors differ");
+  check(same(m(-1.0), first), "below range");
+  check(same(m(2.0), last), "above range");
+  check(same(m(1e12), last), "far above range");
+  check(same(m(-1e12), first), "far below range");
+  check(same(m(1e300), last), "1e300");
+  check(same(m(inf), last), "+inf");
+  check(same(m(-inf), first), "-inf");
+  check(same(m(nan), first), "NaN");
+
+  // An empty range maps everything to the first color.
+  m.set_range(3.0, 3.0);
+  check(same(m(3.0), first), "empty range");
+  check(same(m(inf), first), "empty range, +inf");
+  check(same(m(nan), first), "empty range, NaN");
+
+  if (failures == 0) std::printf("test_colormap: OK\n");
+  return failures == 0 ? 0 : 1;
+}
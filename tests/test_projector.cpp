@@ -0,0 +1,69 @@
+// Orthographic projection: bit-identical to the projector before the
+// perspective camera, which computed every point directly from R (p - center).
+#include "projector.hpp"
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace trj_render;
+
+// The previous Projector::project3d, from the public pieces of the projector.
+static Vector3d reference(const Projector &proj, const Vector3d &bmin, const Vector3d &bmax, double ox, double oy,
+                          const Vector3d &p) {
+  double miny = +1e300, maxy = -1e300;
+  double minz = +1e300, maxz = -1e300;
+  for (int k = 0; k < 8; ++k) {
+    const Vector3d c{(k & 4) ? bmax.x : bmin.x, (k & 2) ? bmax.y : bmin.y, (k & 1) ? bmax.z : bmin.z};
+    const Vector3d v = proj.to_view(c);
+    miny = std::min(miny, v.y);
+    maxy = std::max(maxy, v.y);
+    minz = std::min(minz, v.z);
+    maxz = std::max(maxz, v.z);
+  }
+  const double scale = proj.scale();
+  const Vector3d v = proj.to_view(p);
+  const double cy = 0.5 * (miny + maxy);
+  const double cz = 0.5 * (minz + maxz);
+  const double width = (maxy - miny) * scale;
+  const double height = (maxz - minz) * scale;
+  const double sx = (v.y - cy) * scale + 0.5 * width - ox;
+  const double sy = (v.z - cz) * scale + 0.5 * height - oy;
+  return {sx, sy, v.x};
+}
+
+int main() {
+  int failures = 0;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> angle(-180.0, 180.0), unit(0.0, 1.0);
+  const Vector3d bmin(-3.5, 0.0, 10.0), bmax(40.25, 20.0, 31.0);
+  for (int view = 0; view < 50; view++) {
+    Projector proj(bmin, bmax);
+    // The first view is unrotated, so that box faces project onto exact pixel edges.
+    if (view > 0) {
+      proj.rotateX(angle(rng));
+      proj.rotateY(angle(rng));
+      proj.rotateZ(angle(rng));
+    }
+    proj.setScale(view % 2 ? -1.0 : 7.0 + view);
+    const double ox = (view % 3) * 256.0, oy = (view % 5) * 256.0;
+    proj.setOffset(ox, oy);
+    int wrong = 0;
+    for (int i = 0; i < 1000; i++) {
+      Vector3d p(bmin.x + unit(rng) * (bmax.x - bmin.x), bmin.y + unit(rng) * (bmax.y - bmin.y),
+                 bmin.z + unit(rng) * (bmax.z - bmin.z));
+      if (i < 8) p = Vector3d((i & 4) ? bmax.x : bmin.x, (i & 2) ? bmax.y : bmin.y, (i & 1) ? bmax.z : bmin.z);
+      const Vector3d a = proj.project3d(p);
+      const Vector3d b = reference(proj, bmin, bmax, ox, oy, p);
+      if (std::memcmp(&a.x, &b.x, sizeof(double)) != 0 || std::memcmp(&a.y, &b.y, sizeof(double)) != 0 ||
+          std::memcmp(&a.z, &b.z, sizeof(double)) != 0) {
+        wrong++;
+      }
+    }
+    if (wrong > 0) {
+      std::printf("FAIL orthographic view %d: %d points differ\n", view, wrong);
+      failures++;
+    }
+  }
+  if (failures == 0) std::printf("test_projector: OK\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+// Sprite mask of SphereSprite: exactly the pixels inside the radius are drawn.
+#include "shading.hpp"
+#include <cstdio>
+
+using namespace trj_render;
+
+int main() {
+  int failures = 0;
+  const Color sentinel{1, 2, 3};
+  for (double r : {0.5, 1.0, 2.5, 4.0, 7.3, 16.0, 31.5}) {
+    SphereSprite sprite;
+    sprite.build(r, {200, 100, 50});
+    const int size = 80;
+    const int c = size / 2;
+    Canvas canvas(size, size);
+    canvas.set_color(sentinel);
+    canvas.fill_rect(0, 0, size, size);
+    sprite.draw(canvas, c, c);
+    int wrong = 0;
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        const unsigned char *p = &canvas.image_buffer[(y * size + x) * 4];
+        const bool drawn = !(p[0] == sentinel.r && p[1] == sentinel.g && p[2] == sentinel.b);
+        const double dx = x - c, dy = y - c;
+        const bool inside = dx * dx + dy * dy <= r * r;
+        if (drawn != inside) wrong++;
+      }
+    }
+    if (wrong > 0) {
+      std::printf("FAIL sprite mask r=%g: %d pixels wrong\n", r, wrong);
+      failures++;
+    }
+  }
+  if (failures == 0) std::printf("test_shading: OK\n");
+  return failures == 0 ? 0 : 1;
+}
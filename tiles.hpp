@@ -0,0 +1,151 @@
+#pragma once
+#include "canvas.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace trj_render {
+
+// Writes an image as a DeepZoom (.dzi) tile pyramid without ever holding the
+// whole image in memory. Tiles of the full-resolution level are passed in one
+// by one; finish() builds each lower level from the level above, reading back
+// four tiles at a time.
+//
+//   <name>.dzi
+//   <name>_files/<level>/<col>_<row>.png
+//
+// Failures are reported to std::cerr; write_tile() and finish() return
+// false once anything could not be written.
+class DeepZoomWriter {
+public:
+  DeepZoomWriter(const std::string &name, int width, int height, int tile_size)
+      : name_(name), width_(width), height_(height), tile_(tile_size) {
+    max_level_ = 0;
+    while ((1 << max_level_) < std::max(width_, height_)) {
+      max_level_++;
+    }
+    ok_ = make_dir(name_ + "_files") && make_dir(level_dir(max_level_));
+  }
+
+  int tile_size() const {
+    return tile_;
+  }
+  int columns() const {
+    return (width_ + tile_ - 1) / tile_;
+  }
+  int rows() const {
+    return (height_ + tile_ - 1) / tile_;
+  }
+
+  // Size of tile (col, row) of the full-resolution level.
+  std::pair<int, int> tile_extent(int col, int row) const {
+    return {std::min(tile_, width_ - col * tile_), std::min(tile_, height_ - row * tile_)};
+  }
+
+  bool write_tile(int col, int row, Canvas &tile) {
+    if (ok_) {
+      ok_ = save(tile, tile_path(max_level_, col, row));
+    }
+    return ok_;
+  }
+
+  // Builds levels max_level - 1 ... 0 and writes the descriptor.
+  bool finish() {
+    int w = width_, h = height_;
+    for (int level = max_level_ - 1; level >= 0 && ok_; level--) {
+      ok_ = make_dir(level_dir(level));
+      const int pw = (w + 1) / 2, ph = (h + 1) / 2;
+      for (int row = 0; row * tile_ < ph && ok_; row++) {
+        for (int col = 0; col * tile_ < pw && ok_; col++) {
+          Canvas tile = reduce(level + 1, w, h, col, row);
+          ok_ = save(tile, tile_path(level, col, row));
+        }
+      }
+      w = pw;
+      h = ph;
+    }
+    if (!ok_) return false;
+    std::ofstream dzi(name_ + ".dzi");
+    dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\""
+        << tile_ << "\">\n"
+        << "  <Size Width=\"" << width_ << "\" Height=\"" << height_ << "\"/>\n"
+        << "</Image>\n";
+    dzi.close();
+    if (!dzi) {
+      std::cerr << "Error: could not write " << name_ << ".dzi" << std::endl;
+      ok_ = false;
+    }
+    return ok_;
+  }
+
+private:
+  std::string name_;
+  int width_, height_, tile_;
+  int max_level_;
+  bool ok_ = true;
+
+  std::string level_dir(int level) const {
+    return name_ + "_files/" + std::to_string(level);
+  }
+
+  std::string tile_path(int level, int col, int row) const {
+    std::ostringstream oss;
+    oss << level_dir(level) << "/" << col << "_" << row << ".png";
+    return oss.str();
+  }
+
+  // An existing directory is fine.
+  static bool make_dir(const std::string &path) {
+    if (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST) return true;
+    std::cerr << "Error: could not create directory " << path << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  static bool save(Canvas &tile, const std::string &path) {
+    if (tile.save(path.c_str())) return true;
+    std::cerr << "Error: could not write " << path << std::endl;
+    return false;
+  }
+
+  // Tile (col, row) of the level below `level` (whose image is w x h),
+  // made by box-filtering the (up to) four corresponding tiles of `level`.
+  Canvas reduce(int level, int w, int h, int col, int row) const {
+    const int aw = std::min(2 * (col + 1) * tile_, w) - 2 * col * tile_;
+    const int ah = std::min(2 * (row + 1) * tile_, h) - 2 * row * tile_;
+    const int pw = (aw + 1) / 2, ph = (ah + 1) / 2;
+    Canvas src(2 * pw, 2 * ph);
+    const int line = 2 * pw * 4;
+    for (int j = 0; j < 2; j++) {
+      for (int i = 0; i < 2; i++) {
+        const int c = 2 * col + i, r = 2 * row + j;
+        if (c * tile_ >= w || r * tile_ >= h) continue;
+        std::vector<unsigned char> rgba;
+        unsigned cw = 0, ch = 0;
+        if (lodepng::decode(rgba, cw, ch, tile_path(level, c, r))) continue;
+        for (unsigned y = 0; y < ch; y++) {
+          std::copy_n(rgba.begin() + y * cw * 4, cw * 4,
+                      src.image_buffer.begin() + (j * tile_ + y) * line + i * tile_ * 4);
+        }
+      }
+    }
+    // Odd sizes: repeat the last column / row so that the filter stays unbiased.
+    if (aw % 2) {
+      for (int y = 0; y < ah; y++) {
+        std::copy_n(src.image_buffer.begin() + y * line + (aw - 1) * 4, 4, src.image_buffer.begin() + y * line + aw * 4);
+      }
+    }
+    if (ah % 2) {
+      std::copy_n(src.image_buffer.begin() + (ah - 1) * line, line, src.image_buffer.begin() + ah * line);
+    }
+    return src.downsample(2);
+  }
+};
+
+} // namespace trj_render
@@ -0,0 +1,271 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <lammpstrj/lammpstrj.hpp>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace trj_render {
+
+// Location of one frame in a .lammpstrj file.
+struct FrameEntry {
+  std::uint64_t offset; // Byte offset of "ITEM: TIMESTEP"
+  std::uint64_t size;   // Bytes up to the next frame
+  std::int64_t atoms;   // Number of atoms
+  int index;            // 0-based frame index
+};
+
+// One extra per-atom column, which lammpstrj::Atom has no room for, parsed
+// into its own array. The range is tracked while parsing.
+struct ScalarColumn {
+  std::string name;           // Column name in "ITEM: ATOMS", or "vmag" for |(vx, vy, vz)|
+  std::vector<double> values; // One value per atom, in file order
+  double min = 0.0, max = 0.0;
+  bool found = false;         // Whether the frame had the column
+};
+
+// Sequential reader over a file in large chunks, tracking the byte offset.
+class ChunkReader {
+public:
+  explicit ChunkReader(const std::string &filename)
+      : fin_(filename, std::ios::binary), buf_(1 << 20) {}
+
+  bool good() const {
+    return fin_.is_open();
+  }
+
+  std::uint64_t tell() const {
+    return base_ + pos_;
+  }
+
+  // Continues reading at the given byte offset.
+  void seek(std::uint64_t offset) {
+    fin_.clear();
+    fin_.seekg(static_cast<std::streamoff>(offset));
+    base_ = offset;
+    pos_ = len_ = 0;
+  }
+
+  bool read_line(std::string &line) {
+    line.clear();
+    while (true) {
+      if (pos_ == len_ && !fill()) return !line.empty();
+      const char *p = buf_.data() + pos_;
+      const char *e = static_cast<const char *>(std::memchr(p, '\n', len_ - pos_));
+      if (e) {
+        line.append(p, e);
+        pos_ += (e - p) + 1;
+        return true;
+      }
+      line.append(p, len_ - pos_);
+      pos_ = len_;
+    }
+  }
+
+  // Skips n lines without copying them.
+  bool skip_lines(std::int64_t n) {
+    while (n > 0) {
+      if (pos_ == len_ && !fill()) return false;
+      const char *p = buf_.data() + pos_;
+      const char *e = static_cast<const char *>(std::memchr(p, '\n', len_ - pos_));
+      if (e) {
+        pos_ += (e - p) + 1;
+        n--;
+      } else {
+        pos_ = len_;
+      }
+    }
+    return true;
+  }
+
+private:
+  std::ifstream fin_;
+  std::vector<char> buf_;
+  std::uint64_t base_ = 0;
+  std::size_t pos_ = 0, len_ = 0;
+
+  bool fill() {
+    base_ += len_;
+    fin_.read(buf_.data(), buf_.size());
+    len_ = static_cast<std::size_t>(fin_.gcount());
+    pos_ = 0;
+    return len_ > 0;
+  }
+};
+
+// Finds the byte range and atom count of every frame. Only the header lines
+// are parsed; atom lines are skipped by counting newlines.
+inline std::vector<FrameEntry> scan_frames(const std::string &filename) {
+  std::vector<FrameEntry> frames;
+  ChunkReader reader(filename);
+  if (!reader.good()) return frames;
+  std::string line;
+  std::uint64_t offset = reader.tell();
+  while (reader.read_line(line)) {
+    if (line.compare(0, 14, "ITEM: TIMESTEP") != 0) {
+      offset = reader.tell();
+      continue;
+    }
+    std::int64_t atoms = -1;
+    while (reader.read_line(line)) {
+      if (line.compare(0, 21, "ITEM: NUMBER OF ATOMS") == 0) {
+        reader.read_line(line);
+        atoms = std::strtoll(line.c_str(), nullptr, 10);
+      } else if (line.compare(0, 11, "ITEM: ATOMS") == 0) {
+        break;
+      }
+    }
+    if (atoms < 0 || !reader.skip_lines(atoms)) break;
+    const int index = static_cast<int>(frames.size());
+    frames.push_back({offset, reader.tell() - offset, atoms, index});
+    offset = reader.tell();
+  }
+  return frames;
+}
+
+// Reads the header of the next frame, up to its "ITEM: ATOMS" line, into si
+// and the column names. Returns false at the end of the file.
+inline bool read_header(ChunkReader &reader, lammpstrj::SystemInfo &si, std::vector<std::string> &columns) {
+  std::string line;
+  do {
+    if (!reader.read_line(line)) return false;
+  } while (line.compare(0, 14, "ITEM: TIMESTEP") != 0);
+  if (!reader.read_line(line)) return false;
+  si.timestep = std::strtoll(line.c_str(), nullptr, 10);
+  double *bounds[3][2] = {{&si.x_min, &si.x_max}, {&si.y_min, &si.y_max}, {&si.z_min, &si.z_max}};
+  si.atoms = -1;
+  columns.clear();
+  while (reader.read_line(line)) {
+    if (line.compare(0, 21, "ITEM: NUMBER OF ATOMS") == 0) {
+      reader.read_line(line);
+      si.atoms = std::strtoll(line.c_str(), nullptr, 10);
+    } else if (line.compare(0, 16, "ITEM: BOX BOUNDS") == 0) {
+      for (auto &b : bounds) {
+        reader.read_line(line);
+        std::istringstream ss(line);
+        ss >> *b[0] >> *b[1];
+      }
+    } else if (line.compare(0, 11, "ITEM: ATOMS") == 0) {
+      std::istringstream ss(line.substr(11));
+      std::string c;
+      while (ss >> c) columns.push_back(c);
+      return si.atoms >= 0;
+    }
+  }
+  return false;
+}
+
+// Skips the next frame, parsing only its header.
+inline bool skip_frame(ChunkReader &reader) {
+  lammpstrj::SystemInfo si{};
+  std::vector<std::string> columns;
+  return read_header(reader, si, columns) && reader.skip_lines(si.atoms);
+}
+
+// Reads the next frame and, if `column` is given, that column in the same
+// pass over the atom lines. Unscaled (x, xu) and scaled (xs, xsu)
+// coordinates are accepted. Returns nullptr at the end of the file.
+inline std::unique_ptr<lammpstrj::SystemInfo> read_frame(ChunkReader &reader, std::vector<lammpstrj::Atom> &atoms,
+                                                         ScalarColumn *column = nullptr) {
+  auto si = std::make_unique<lammpstrj::SystemInfo>();
+  std::vector<std::string> columns;
+  if (!read_header(reader, *si, columns)) return nullptr;
+
+  enum Field { Skip, Id, Type, X, Y, Z, XS, YS, ZS, Value, VComponent };
+  std::vector<Field> fields(columns.size(), Skip);
+  const bool vmag = column && column->name == "vmag";
+  for (std::size_t k = 0; k < columns.size(); k++) {
+    const std::string &c = columns[k];
+    if (column && c == column->name) fields[k] = Value;
+    else if (vmag && (c == "vx" || c == "vy" || c == "vz")) fields[k] = VComponent;
+    else if (c == "id") fields[k] = Id;
+    else if (c == "type") fields[k] = Type;
+    else if (c == "x" || c == "xu") fields[k] = X;
+    else if (c == "y" || c == "yu") fields[k] = Y;
+    else if (c == "z" || c == "zu") fields[k] = Z;
+    else if (c == "xs" || c == "xsu") fields[k] = XS;
+    else if (c == "ys" || c == "ysu") fields[k] = YS;
+    else if (c == "zs" || c == "zsu") fields[k] = ZS;
+  }
+
+  double *values = nullptr;
+  if (column) {
+    column->found = std::count(fields.begin(), fields.end(), Value) == 1 ||
+                    std::count(fields.begin(), fields.end(), VComponent) == 3;
+    column->values.assign(column->found ? static_cast<std::size_t>(si->atoms) : 0, 0.0);
+    column->min = std::numeric_limits<double>::infinity();
+    column->max = -std::numeric_limits<double>::infinity();
+    values = column->found ? column->values.data() : nullptr;
+  }
+
+  atoms.resize(static_cast<std::size_t>(si->atoms));
+  std::string line;
+  for (auto &a : atoms) {
+    if (!reader.read_line(line)) return nullptr;
+    a = lammpstrj::Atom{};
+    const char *p = line.c_str();
+    double value = 0.0;
+    for (Field f : fields) {
+      char *q;
+      const double v = std::strtod(p, &q);
+      if (q == p) {
+        // Non-numeric column (e.g. element): skip the token.
+        while (*p == ' ' || *p == '\t') p++;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        continue;
+      }
+      p = q;
+      switch (f) {
+      case Id: a.id = static_cast<int>(v); break;
+      case Type: a.type = static_cast<int>(v); break;
+      case X: a.x = v; break;
+      case Y: a.y = v; break;
+      case Z: a.z = v; break;
+      case XS: a.x = si->x_min + v * (si->x_max - si->x_min); break;
+      case YS: a.y = si->y_min + v * (si->y_max - si->y_min); break;
+      case ZS: a.z = si->z_min + v * (si->z_max - si->z_min); break;
+      case Value: value = v; break;
+      case VComponent: value += v * v; break;
+      case Skip: break;
+      }
+    }
+    if (values) {
+      if (vmag) value = std::sqrt(value);
+      *values++ = value;
+      column->min = std::min(column->min, value);
+      column->max = std::max(column->max, value);
+    }
+  }
+  return si;
+}
+
+// Reads the frame described by `entry`, starting at its byte offset. Without
+// a column, the lammpstrj parser reads it; lammpstrj::Atom has no room for
+// extra columns, so with one, read_frame() parses both in one pass.
+// Returns nullptr if the frame could not be read.
+inline std::unique_ptr<lammpstrj::SystemInfo> read_frame_at(const std::string &filename, const FrameEntry &entry,
+                                                            std::vector<lammpstrj::Atom> &atoms,
+                                                            ScalarColumn *column = nullptr) {
+  std::unique_ptr<lammpstrj::SystemInfo> si;
+  if (column) {
+    ChunkReader reader(filename);
+    reader.seek(entry.offset);
+    si = read_frame(reader, atoms, column);
+  } else {
+    std::ifstream fin(filename, std::ios::binary);
+    fin.seekg(static_cast<std::streamoff>(entry.offset));
+    si = lammpstrj::read_frame(fin, atoms);
+  }
+  if (si) si->frame_index = entry.index;
+  return si;
+}
+
+} // namespace trj_render
@@ -0,0 +1,132 @@
+#include "trjrender.hpp"
+#include "renderer.hpp"
+#include <lodepng.h>
+#include <stdexcept>
+#include <string>
+
+namespace trj_render {
+
+struct FrameRenderer::Impl {
+  RenderOptions options;
+  Projector projector;
+  Renderer renderer;
+  Box box{};
+  bool has_box = false;
+  std::vector<lammpstrj::Atom> atoms; // Copy of the spans, reused between calls
+
+  explicit Impl(const RenderOptions &opt)
+      : options(opt), projector(Vector3d(0, 0, 0), Vector3d(1, 1, 1)), renderer(projector) {
+    renderer.set_antialias(options.aa);
+    renderer.set_shading(options.shade);
+    for (const auto &[type, r] : options.radius) {
+      if (!renderer.set_atom_radius(type, r)) invalid_type("radius", type);
+    }
+    for (const auto &[pair, rc] : options.bonds) {
+      if (!renderer.set_bond(pair.first, pair.second, rc)) invalid_type("bonds", (pair.first < 0) ? pair.first : pair.second);
+    }
+    renderer.set_bond_width(options.bond_width);
+    renderer.set_periodic(options.periodic);
+    for (int type : options.hidden_types) {
+      if (type < 0) invalid_type("hidden_types", type);
+      renderer.add_condition(std::make_unique<AtomTypeCondition>(type, false));
+    }
+    for (int type : options.static_types) {
+      if (!renderer.add_static_type(type)) invalid_type("static_types", type);
+    }
+    if (!renderer.set_colormap(options.colormap)) {
+      throw std::invalid_argument("RenderOptions::colormap: unknown colormap " + options.colormap);
+    }
+    if (options.fixed_color_range) {
+      renderer.set_color_range(options.color_min, options.color_max);
+    }
+  }
+
+  [[noreturn]] static void invalid_type(const char *option, int type) {
+    throw std::invalid_argument(std::string("RenderOptions::") + option + ": invalid atom type " + std::to_string(type));
+  }
+
+  // The view depends on the box, so it is rebuilt when the box changes.
+  void update_box(const Box &b) {
+    if (has_box && std::equal(b.lo, b.lo + 3, box.lo) && std::equal(b.hi, b.hi + 3, box.hi)) return;
+    box = b;
+    has_box = true;
+    Projector proj(Vector3d(b.lo[0], b.lo[1], b.lo[2]), Vector3d(b.hi[0], b.hi[1], b.hi[2]));
+    proj.rotateX(options.rx);
+    proj.rotateY(options.ry);
+    proj.rotateZ(options.rz);
+    proj.setScale(options.scale);
+    proj.setPerspective(options.fov, options.eye);
+    renderer.set_projector(proj);
+  }
+
+  Image render(const Box &b, const AtomSpans &spans) {
+    update_box(b);
+    auto si = std::make_unique<lammpstrj::SystemInfo>();
+    si->x_min = b.lo[0];
+    si->y_min = b.lo[1];
+    si->z_min = b.lo[2];
+    si->x_max = b.hi[0];
+    si->y_max = b.hi[1];
+    si->z_max = b.hi[2];
+    atoms.resize(spans.n);
+    for (std::size_t i = 0; i < spans.n; i++) {
+      auto &a = atoms[i];
+      a.x = spans.x[i];
+      a.y = spans.y[i];
+      a.z = spans.z[i];
+      a.type = spans.type[i];
+      a.id = spans.id ? spans.id[i] : static_cast<int>(i) + 1;
+    }
+    double vmin = 0.0, vmax = 0.0;
+    if (spans.scalar && spans.n > 0 && !options.fixed_color_range) {
+      const auto [lo, hi] = std::minmax_element(spans.scalar, spans.scalar + spans.n);
+      vmin = *lo;
+      vmax = *hi;
+    }
+    renderer.set_scalar(spans.scalar, vmin, vmax);
+    Canvas canvas = renderer.render_frame(si, atoms);
+    renderer.set_scalar(nullptr, 0.0, 0.0);
+    Image image;
+    image.width = canvas.get_width();
+    image.height = canvas.get_height();
+    image.rgba = std::move(canvas.image_buffer);
+    return image;
+  }
+};
+
+FrameRenderer::FrameRenderer(const RenderOptions &options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+FrameRenderer::~FrameRenderer() = default;
+
+Image FrameRenderer::render(const Box &box, const AtomSpans &atoms) {
+  return impl_->render(box, atoms);
+}
+
+void FrameRenderer::render(const Box &box, const AtomSpans &atoms, const ImageSink &sink, long step) {
+  sink(impl_->render(box, atoms), step);
+}
+
+bool FrameRenderer::save_png(const Image &image, const std::string &filename) {
+  return lodepng::encode(filename, image.rgba, image.width, image.height) == 0;
+}
+
+InSituRenderer::InSituRenderer(const RenderOptions &options, long interval, ImageSink sink,
+                               const std::string &prefix)
+    : renderer_(options), interval_(interval > 0 ? interval : 1), sink_(std::move(sink)), prefix_(prefix) {}
+
+bool InSituRenderer::step(long step, const Box &box, const AtomSpans &atoms) {
+  if (step % interval_ != 0) return false;
+  if (sink_) {
+    renderer_.render(box, atoms, sink_, step);
+    return true;
+  }
+  const Image image = renderer_.render(box, atoms);
+  const std::string filename = prefix_ + "." + std::to_string(step) + ".png";
+  if (!FrameRenderer::save_png(image, filename)) {
+    throw std::runtime_error("InSituRenderer: could not write " + filename);
+  }
+  return true;
+}
+
+} // namespace trj_render
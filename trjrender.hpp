@@ -0,0 +1,105 @@
+#pragma once
+// Library interface of trj-render (libtrjrender.a).
+//
+// Renders atoms given as structure-of-arrays spans owned by the caller, so
+// a running simulation can produce images in situ without writing a
+// trajectory. Only the standard library is needed to include this header.
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace trj_render {
+
+// Coordinates and types of n atoms. They are copied on every call into a
+// per-atom array owned by the renderer (reused between calls), so rendering
+// needs about as much memory again as the spans. The arrays only need to
+// stay valid during the call. `id` may be null (it is only used for static IDs).
+// `scalar` may be null; if given, atoms are colored by it (see RenderOptions).
+struct AtomSpans {
+  std::size_t n = 0;
+  const double *x = nullptr;
+  const double *y = nullptr;
+  const double *z = nullptr;
+  const int *type = nullptr;
+  const int *id = nullptr;
+  const double *scalar = nullptr;
+};
+
+// Simulation box.
+struct Box {
+  double lo[3];
+  double hi[3];
+};
+
+// RGBA image, 4 bytes per pixel, rows from top to bottom.
+struct Image {
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> rgba;
+};
+
+// Receives each rendered image with the step (or frame index) it belongs to.
+using ImageSink = std::function<void(const Image &image, long step)>;
+
+// Same meaning as the options of trj2png.
+struct RenderOptions {
+  double rx = 0.0, ry = 0.0, rz = 0.0; // Rotation around X, Y, Z (degrees)
+  double scale = -1.0;                 // Pixels per length unit (negative: fit 800 pixels)
+  double fov = 0.0;                    // Perspective field of view (degrees, 0: orthographic)
+  double eye = 0.0;                    // Eye distance from the box center (0: automatic)
+  int aa = 1;                          // Antialiasing factor
+  bool shade = false;                  // Shaded spheres
+  std::map<int, double> radius;        // Radius per atom type
+  std::vector<int> hidden_types;       // Atom types not drawn
+  std::map<std::pair<int, int>, double> bonds; // Bond cutoff per type pair
+  int bond_width = 1;                  // Line width of bonds in pixels
+  bool periodic = true;                // Search bonds across the box faces
+  std::vector<int> static_types;       // Atom types cached in a background layer
+  std::string colormap = "viridis";    // Colormap for AtomSpans::scalar
+  bool fixed_color_range = false;      // Use [color_min, color_max] instead of the per-call range
+  double color_min = 0.0, color_max = 1.0;
+};
+
+class FrameRenderer {
+public:
+  // Throws std::invalid_argument if options name a negative atom type or an
+  // unknown colormap.
+  explicit FrameRenderer(const RenderOptions &options = RenderOptions());
+  ~FrameRenderer();
+  FrameRenderer(const FrameRenderer &) = delete;
+  FrameRenderer &operator=(const FrameRenderer &) = delete;
+
+  Image render(const Box &box, const AtomSpans &atoms);
+  void render(const Box &box, const AtomSpans &atoms, const ImageSink &sink, long step);
+
+  static bool save_png(const Image &image, const std::string &filename);
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+// Renders every `interval`-th step. Without a sink, images are written as
+// <prefix>.<step>.png.
+class InSituRenderer {
+public:
+  InSituRenderer(const RenderOptions &options, long interval, ImageSink sink = ImageSink(),
+                 const std::string &prefix = "frame");
+
+  // Call once per simulation step; returns true if the step was rendered.
+  // Throws std::runtime_error if, without a sink, the image could not be
+  // written.
+  bool step(long step, const Box &box, const AtomSpans &atoms);
+
+private:
+  FrameRenderer renderer_;
+  long interval_;
+  ImageSink sink_;
+  std::string prefix_;
+};
+
+} // namespace trj_render